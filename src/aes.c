@@ -33,6 +33,40 @@
 #define aes128_key_exp(k, rcon) aes128_key_expansion(k, _mm_aeskeygenassist_si128(k, rcon))
 
 
+/* One step back in the key schedule: (w0, w1, w2, w3) -> (w0 ^ SubWord(RotWord(w3 ^ w2)) ^ rcon, w1 ^ w0, w2 ^ w1, w3 ^ w2).
+ * With GFNI the SBox is a single affine-inverse instruction on the rotated word, otherwise AESKEYGENASSIST computes it. */
+#ifdef __GFNI__
+#include <immintrin.h>
+
+#define INV_KEY_STEP(k, rcon) \
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 0x4)); \
+    k = _mm_xor_si128(k, _mm_xor_si128(_mm_and_si128(_mm_gf2p8affineinv_epi64_epi8(_mm_shuffle_epi8(k, rot), affine, 0x63), lo), _mm_cvtsi32_si128(rcon)));
+
+#ifdef __AVX512BW__
+/* Four key schedules per 512-bit register, one in each 128-bit lane */
+#define INV_KEY_STEP_512(k, rcon) \
+    k = _mm512_xor_si512(k, _mm512_bslli_epi128(k, 0x4)); \
+    k = _mm512_xor_si512(k, _mm512_xor_si512(_mm512_and_si512(_mm512_gf2p8affineinv_epi64_epi8(_mm512_shuffle_epi8(k, rot512), affine512, 0x63), lo512), rcon512[rcon]));
+#endif
+#else
+#define INV_KEY_STEP(k, rcon) \
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 0x4)); \
+    k = _mm_xor_si128(k, _mm_and_si128(_mm_shuffle_epi32(_mm_aeskeygenassist_si128(k, rcon), _MM_SHUFFLE(0x3, 0x3, 0x3, 0x3)), lo));
+#endif
+
+#define INV_KEY_SCHEDULE(k) \
+    INV_KEY_STEP(k, 0x36); \
+    INV_KEY_STEP(k, 0x1b); \
+    INV_KEY_STEP(k, 0x80); \
+    INV_KEY_STEP(k, 0x40); \
+    INV_KEY_STEP(k, 0x20); \
+    INV_KEY_STEP(k, 0x10); \
+    INV_KEY_STEP(k, 0x08); \
+    INV_KEY_STEP(k, 0x04); \
+    INV_KEY_STEP(k, 0x02); \
+    INV_KEY_STEP(k, 0x01);
+
+
 /*** PRIVATE ***/
 
 static __m128i aes128_key_expansion(__m128i key, __m128i keygened)
@@ -95,7 +129,7 @@ uint8_t* encrypt(uint8_t* key, uint8_t* plainText)
     __m128i key_schedule[0x14];
     aes128_loadkey_enc(key, key_schedule);
     uint8_t* cipherText;
-    cipherText = (uint8_t*) malloc(sizeof(plainText));
+    cipherText = (uint8_t*) malloc(0x10);
     if(cipherText == NULL)
     {
         printf("ERROR !!!\n");
@@ -110,7 +144,7 @@ uint8_t* decrypt(uint8_t* key, uint8_t* cipherText)
     __m128i key_schedule[0x14];
     aes128_load_key(key, key_schedule);
     uint8_t* plainText;
-    plainText = (uint8_t*) malloc(sizeof(cipherText));
+    plainText = (uint8_t*) malloc(0x10);
     if(plainText == NULL)
     {
         printf("ERROR !!!\n");
@@ -120,6 +154,155 @@ uint8_t* decrypt(uint8_t* key, uint8_t* cipherText)
     return plainText;
 }
 
+#ifdef INV_KEY_STEP_512
+#define INV_KEY_SCHEDULE_512(k) \
+    INV_KEY_STEP_512(k, 0x9); \
+    INV_KEY_STEP_512(k, 0x8); \
+    INV_KEY_STEP_512(k, 0x7); \
+    INV_KEY_STEP_512(k, 0x6); \
+    INV_KEY_STEP_512(k, 0x5); \
+    INV_KEY_STEP_512(k, 0x4); \
+    INV_KEY_STEP_512(k, 0x3); \
+    INV_KEY_STEP_512(k, 0x2); \
+    INV_KEY_STEP_512(k, 0x1); \
+    INV_KEY_STEP_512(k, 0x0);
+
+/* Sixteen key schedules at a time, returns the number of keys done */
+static size_t invert_key_schedule_512(const uint8_t* k10, uint8_t* mk, size_t n)
+{
+    static const uint8_t rcon10[0xa] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+    const __m512i lo512 = _mm512_maskz_broadcast_i32x4(0xffff, _mm_set_epi32(0x0, 0x0, 0x0, -0x1));
+    const __m512i rot512 = _mm512_maskz_broadcast_i32x4(0xffff, _mm_set_epi8(-0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, 0xc, 0xf, 0xe, 0xd));
+    const __m512i affine512 = _mm512_set1_epi64(0xf1e3c78f1f3e7cf8);
+    __m512i rcon512[0xa];
+    for(size_t r = 0x0; r < 0xa; ++r)
+    {
+        rcon512[r] = _mm512_maskz_broadcast_i32x4(0xffff, _mm_cvtsi32_si128(rcon10[r]));
+    }
+
+    size_t i = 0x0;
+    for(; i + 0x10 <= n; i += 0x10)
+    {
+        __m512i a = _mm512_loadu_si512((const void*) (k10 + 0x10 * i));
+        __m512i b = _mm512_loadu_si512((const void*) (k10 + 0x10 * i + 0x40));
+        __m512i c = _mm512_loadu_si512((const void*) (k10 + 0x10 * i + 0x80));
+        __m512i d = _mm512_loadu_si512((const void*) (k10 + 0x10 * i + 0xc0));
+        INV_KEY_SCHEDULE_512(a);
+        INV_KEY_SCHEDULE_512(b);
+        INV_KEY_SCHEDULE_512(c);
+        INV_KEY_SCHEDULE_512(d);
+        _mm512_storeu_si512((void*) (mk + 0x10 * i), a);
+        _mm512_storeu_si512((void*) (mk + 0x10 * i + 0x40), b);
+        _mm512_storeu_si512((void*) (mk + 0x10 * i + 0x80), c);
+        _mm512_storeu_si512((void*) (mk + 0x10 * i + 0xc0), d);
+    }
+    return i;
+}
+#endif
+
+/* Master keys of 'n' 10-th round keys, several independent key schedules at a time */
+void invert_key_schedule(const uint8_t* k10, uint8_t* mk, size_t n)
+{
+    const __m128i lo = _mm_set_epi32(0x0, 0x0, 0x0, -0x1);
+#ifdef __GFNI__
+    const __m128i rot = _mm_set_epi8(-0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, -0x1, 0xc, 0xf, 0xe, 0xd);
+    const __m128i affine = _mm_set1_epi64x(0xf1e3c78f1f3e7cf8);
+#endif
+    size_t i = 0x0;
+#ifdef INV_KEY_STEP_512
+    i = invert_key_schedule_512(k10, mk, n);
+#endif
+    for(; i + 0x4 <= n; i += 0x4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*) (k10 + 0x10 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (k10 + 0x10 * i + 0x10));
+        __m128i c = _mm_loadu_si128((const __m128i*) (k10 + 0x10 * i + 0x20));
+        __m128i d = _mm_loadu_si128((const __m128i*) (k10 + 0x10 * i + 0x30));
+        INV_KEY_SCHEDULE(a);
+        INV_KEY_SCHEDULE(b);
+        INV_KEY_SCHEDULE(c);
+        INV_KEY_SCHEDULE(d);
+        _mm_storeu_si128((__m128i*) (mk + 0x10 * i), a);
+        _mm_storeu_si128((__m128i*) (mk + 0x10 * i + 0x10), b);
+        _mm_storeu_si128((__m128i*) (mk + 0x10 * i + 0x20), c);
+        _mm_storeu_si128((__m128i*) (mk + 0x10 * i + 0x30), d);
+    }
+    for(; i < n; ++i)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*) (k10 + 0x10 * i));
+        INV_KEY_SCHEDULE(a);
+        _mm_storeu_si128((__m128i*) (mk + 0x10 * i), a);
+    }
+}
+
+#if defined(__VAES__) && defined(__GFNI__) && defined(__AVX512BW__)
+/* Forward key expansion step of four key schedules per 512-bit register: prefix xor of the words plus SubWord(RotWord(w3)) ^ rcon */
+#define KEY_STEP_512(k, rcon) \
+    t = _mm512_xor_si512(_mm512_gf2p8affineinv_epi64_epi8(_mm512_shuffle_epi8(k, rot512), affine512, 0x63), _mm512_set1_epi32(rcon)); \
+    k = _mm512_xor_si512(k, _mm512_bslli_epi128(k, 0x4)); \
+    k = _mm512_xor_si512(k, _mm512_bslli_epi128(k, 0x8)); \
+    k = _mm512_xor_si512(k, t);
+
+#define ENC_ROUND_512(k, rcon) \
+    KEY_STEP_512(k, rcon); \
+    m = _mm512_aesenc_epi128(m, k);
+
+/* Index of the first key among the four in 'k' mapping 'pt' onto 'ct', 4 if none */
+static size_t verify_keys_512(__m512i k, const __m512i pt, const __m512i ct)
+{
+    const __m512i rot512 = _mm512_maskz_broadcast_i32x4(0xffff, _mm_set_epi8(0xc, 0xf, 0xe, 0xd, 0xc, 0xf, 0xe, 0xd, 0xc, 0xf, 0xe, 0xd, 0xc, 0xf, 0xe, 0xd));
+    const __m512i affine512 = _mm512_set1_epi64(0xf1e3c78f1f3e7cf8);
+    __m512i t;
+    __m512i m = _mm512_xor_si512(pt, k);
+    ENC_ROUND_512(k, 0x01);
+    ENC_ROUND_512(k, 0x02);
+    ENC_ROUND_512(k, 0x04);
+    ENC_ROUND_512(k, 0x08);
+    ENC_ROUND_512(k, 0x10);
+    ENC_ROUND_512(k, 0x20);
+    ENC_ROUND_512(k, 0x40);
+    ENC_ROUND_512(k, 0x80);
+    ENC_ROUND_512(k, 0x1b);
+    KEY_STEP_512(k, 0x36);
+    m = _mm512_aesenclast_epi128(m, k);
+
+    __mmask8 eq = _mm512_cmpeq_epi64_mask(m, ct);
+    eq &= eq >> 0x1;
+    eq &= 0x55;
+    return eq ? __builtin_ctz(eq) / 0x2 : 0x4;
+}
+#endif
+
+/* Index of the first of 'n' master keys that encrypts 'pt' to 'ct', 'n' if there is none */
+size_t verify_keys(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct)
+{
+    size_t i = 0x0;
+#if defined(__VAES__) && defined(__GFNI__) && defined(__AVX512BW__)
+    const __m512i pt512 = _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128((const __m128i*) pt));
+    const __m512i ct512 = _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128((const __m128i*) ct));
+    for(; i + 0x4 <= n; i += 0x4)
+    {
+        size_t j = verify_keys_512(_mm512_loadu_si512((const void*) (keys + 0x10 * i)), pt512, ct512);
+        if(j < 0x4)
+        {
+            return i + j;
+        }
+    }
+#endif
+    __m128i key_schedule[0x14];
+    uint8_t c[0x10];
+    for(; i < n; ++i)
+    {
+        aes128_loadkey_enc((uint8_t*) keys + 0x10 * i, key_schedule);
+        aes128_enc(key_schedule, (uint8_t*) pt, c);
+        if(!memcmp(c, ct, 0x10))
+        {
+            return i;
+        }
+    }
+    return n;
+}
+
 /* Return 0x0 if OK, 0x1 if encryption failed, 0x2 if decryption failed, 0x3 if both failed */
 int self_test(void)
 {
@@ -10,8 +10,12 @@
 #include <string.h>     //for memcmp
 #include <wmmintrin.h>  //for intrinsics for AES-NI
 
+#include "kernel.hpp"
+
 uint8_t* encrypt(uint8_t *key, uint8_t* plainTex);
 uint8_t* decrypt(uint8_t *key, uint8_t* cipherText);
+void invert_key_schedule(const uint8_t* k10, uint8_t* mk, size_t n);
+size_t verify_keys(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct);
 int self_test(void);
 
 #endif
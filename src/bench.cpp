@@ -0,0 +1,198 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+/* Scaling benchmark of the full pipeline on generated pairs
+ *
+ *   ./bench [--threads=N] [--pairs=m] [--fraction=f] [--seed=s]
+ *
+ * Strong scaling: the same 'm' pairs analysed with 1, 2, 4, ..., N threads.
+ * Weak scaling: 't' pairs analysed back to back with 't' threads, reported as pairs per hour.
+ * With '--fraction' only that share of the column-0 tuples goes through the improved filter, times are extrapolated. */
+
+#include <numeric>
+
+#include "dfa.hpp"
+#include "kernel.hpp"
+
+static uint64_t seed = 0x2545f4914f6cdd1d;
+
+/* xorshift64*, so that every run analyses the same pairs */
+static uint8_t random_byte()
+{
+    seed ^= seed >> 0xc;
+    seed ^= seed << 0x19;
+    seed ^= seed >> 0x1b;
+    return (seed * 0x2545f4914f6cdd1d) >> 0x38;
+}
+
+/* Generated pair: correct and faulty ciphertext, fault location and master key */
+struct Pair
+{
+    State c;
+    State d;
+    size_t l;
+    State key;
+};
+
+static Pair generate()
+{
+    Pair x;
+    State p;
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        x.key[i] = random_byte();
+        p[i] = random_byte();
+    }
+    x.l = random_byte() % 0x10;
+    uint8_t f = 0x0;
+    while(f == 0x0)
+    {
+        f = random_byte();
+    }
+    x.c = encrypt_fault(x.key, p, 0x0, 0x0, 0x0);
+    x.d = encrypt_fault(x.key, p, 0x8, x.l, f);
+    return x;
+}
+
+/* Timing of one or more analyses, improved filter extrapolated to the full candidate space */
+struct Timing
+{
+    double total;
+    double filter;
+    vector<double> busy;
+    bool found;
+};
+
+static Timing run(vector<Pair> &pairs, const size_t cores, const double fraction)
+{
+    Timing t;
+    t.total = 0x0;
+    t.filter = 0x0;
+    t.busy.assign(cores, 0x0);
+    t.found = true;
+    for(size_t i = 0x0; i < pairs.size(); ++i)
+    {
+        Pair &x = pairs[i];
+        double t0 = omp_get_wtime();
+        vector<VKeyTuple> cmb = columns(x.c, x.d, x.l);
+        double t1 = omp_get_wtime();
+
+        /* Evenly spaced share of the column-0 tuples */
+        if(fraction < 0x1)
+        {
+            VKeyTuple v;
+            const size_t m = max((size_t) 0x1, (size_t) (cmb[0x0].size() * fraction));
+            for(size_t j = 0x0; j < m; ++j)
+            {
+                v.push_back(cmb[0x0][j * cmb[0x0].size() / m]);
+            }
+            cmb[0x0] = v;
+        }
+
+        vector<double> busy;
+        vector<vector<State>> r(0x1);
+        r[0x0] = search(x.c, x.d, cmb, x.l, cores, &busy);
+        double t2 = omp_get_wtime();
+        vector<State> keys = postproc(r);
+        double t3 = omp_get_wtime();
+
+        t.filter += (t2 - t1) / fraction;
+        t.total += (t1 - t0) + (t2 - t1) / fraction + (t3 - t2);
+        for(size_t j = 0x0; j < cores; ++j)
+        {
+            t.busy[j] += busy[j] / fraction;
+        }
+        t.found &= fraction < 0x1 || find(keys.begin(), keys.end(), x.key) != keys.end();
+    }
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    size_t threads = omp_get_num_procs();
+    size_t m = 0x1;
+    double fraction = 0x1;
+    for(int i = 0x1; i < argc; ++i)
+    {
+        if(!strncmp(argv[i], "--threads=", 0xa))
+        {
+            threads = atoi(argv[i] + 0xa);
+        }
+        else if(!strncmp(argv[i], "--pairs=", 0x8))
+        {
+            m = atoi(argv[i] + 0x8);
+        }
+        else if(!strncmp(argv[i], "--fraction=", 0xb))
+        {
+            fraction = atof(argv[i] + 0xb);
+        }
+        else if(!strncmp(argv[i], "--seed=", 0x7))
+        {
+            seed = strtoull(argv[i] + 0x7, NULL, 0x0) | 0x1;
+        }
+        else
+        {
+            printf("Usage: ./bench [--threads=N] [--pairs=m] [--fraction=f] [--seed=s]\n");
+            return -0x1;
+        }
+    }
+    if(threads < 0x1 || m < 0x1 || fraction <= 0x0 || fraction > 0x1)
+    {
+        printf("ERROR !!!\n");
+        return -0x1;
+    }
+
+    /* 1, 2, 4, ..., threads */
+    vector<size_t> counts;
+    for(size_t t = 0x1; t < threads; t *= 0x2)
+    {
+        counts.push_back(t);
+    }
+    counts.push_back(threads);
+
+    vector<Pair> pairs;
+    for(size_t i = 0x0; i < max(m, threads); ++i)
+    {
+        pairs.push_back(generate());
+    }
+
+    printf("Engine: %s, %d cpus, fraction %g of the improved filter\n\n", engine().name, omp_get_num_procs(), fraction);
+
+    /* Strong scaling */
+    printf("Strong scaling, %lu pair(s)\n", m);
+    printf("%8s %10s %10s %8s %11s %22s\n", "threads", "time [s]", "filter [s]", "speedup", "efficiency", "busy min/avg/max [s]");
+    vector<Pair> fixed(pairs.begin(), pairs.begin() + m);
+    double base = 0x0;
+    for(size_t i = 0x0; i < counts.size(); ++i)
+    {
+        Timing t = run(fixed, counts[i], fraction);
+        if(i == 0x0)
+        {
+            base = t.total;
+        }
+        double lo = *min_element(t.busy.begin(), t.busy.end());
+        double hi = *max_element(t.busy.begin(), t.busy.end());
+        double avg = accumulate(t.busy.begin(), t.busy.end(), 0.0) / t.busy.size();
+        printf("%8lu %10.3f %10.3f %8.2f %10.1f%% %6.3f/%6.3f/%6.3f%s\n", counts[i], t.total, t.filter, base / t.total,
+               100.0 * base / (t.total * counts[i]), lo, avg, hi, t.found ? "" : "  KEY MISSING !!!");
+        fflush(stdout);
+    }
+
+    /* Weak scaling: one pair per thread */
+    printf("\nWeak scaling, one pair per thread\n");
+    printf("%8s %6s %10s %12s %11s\n", "threads", "pairs", "time [s]", "pairs/hour", "efficiency");
+    for(size_t i = 0x0; i < counts.size(); ++i)
+    {
+        vector<Pair> v(pairs.begin(), pairs.begin() + counts[i]);
+        Timing t = run(v, counts[i], fraction);
+        if(i == 0x0)
+        {
+            base = t.total;
+        }
+        printf("%8lu %6lu %10.3f %12.1f %10.1f%%%s\n", counts[i], counts[i], t.total, 3600.0 * counts[i] / t.total,
+               100.0 * base / t.total, t.found ? "" : "  KEY MISSING !!!");
+        fflush(stdout);
+    }
+    return 0x0;
+}
@@ -0,0 +1,173 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+
+/* Cache directory, empty if caching is off */
+static string cache_dir;
+static size_t cache_limit = CACHE_LIMIT;
+
+/* File header: magic, the full key of the entry and the number of survivors */
+struct CacheHeader
+{
+    char magic[0x4];
+    uint32_t version;
+    uint8_t c[0x10];
+    uint8_t d[0x10];
+    uint8_t l;
+    char model[0x7];
+    uint64_t n;
+};
+
+static CacheHeader header(const State &c, const State &d, const size_t l, const string model)
+{
+    CacheHeader h;
+    memset(&h, 0x0, sizeof(h));
+    memcpy(h.magic, "DFAC", 0x4);
+    h.version = CACHE_VERSION;
+    memcpy(h.c, c.data(), 0x10);
+    memcpy(h.d, d.data(), 0x10);
+    h.l = l;
+    memcpy(h.model, model.c_str(), min(model.size(), sizeof(h.model) - 0x1));
+    return h;
+}
+
+/* File of an entry, named after the FNV-1a hash of its header (without the count) */
+static string path(const CacheHeader &h)
+{
+    uint64_t x = 0xcbf29ce484222325;
+    const uint8_t* p = (const uint8_t*) &h;
+    for(size_t i = 0x0; i < offsetof(CacheHeader, n); ++i)
+    {
+        x = (x ^ p[i]) * 0x100000001b3;
+    }
+    char name[0x20];
+    snprintf(name, sizeof(name), "%016lx.dfac", (unsigned long) x);
+    return cache_dir + "/" + name;
+}
+
+/* Removes the least recently used entries until the directory fits into the size limit, by modification time in nanoseconds
+ * since several entries are usually used within the same second */
+static void evict()
+{
+    DIR* dir = opendir(cache_dir.c_str());
+    if(dir == NULL)
+    {
+        return;
+    }
+    vector<pair<pair<time_t, long>, pair<string, size_t>>> files;
+    size_t total = 0x0;
+    for(struct dirent* e = readdir(dir); e != NULL; e = readdir(dir))
+    {
+        const string name = e->d_name;
+        struct stat st;
+        if(name.size() < 0x5 || name.compare(name.size() - 0x5, 0x5, ".dfac") || stat((cache_dir + "/" + name).c_str(), &st))
+        {
+            continue;
+        }
+        files.push_back(make_pair(make_pair(st.st_mtim.tv_sec, st.st_mtim.tv_nsec), make_pair(cache_dir + "/" + name, (size_t) st.st_size)));
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    sort(files.begin(), files.end());
+    for(size_t i = 0x0; i < files.size() && total > cache_limit; ++i)
+    {
+        if(!unlink(files[i].second.first.c_str()))
+        {
+            total -= files[i].second.second;
+        }
+    }
+}
+
+/* Turns the cache on, entries live in 'dir' (created if missing) which is kept below 'limit' bytes */
+void cache_open(const string dir, const size_t limit)
+{
+    mkdir(dir.c_str(), 0755);
+    cache_dir = dir;
+    cache_limit = limit;
+}
+
+/* Surviving 10-th round keys of (c, d) with a fault in 'l', false if not cached. Entries whose header or size do not add up
+ * (truncated, corrupt or of an older version) are removed. */
+bool cache_get(const State &c, const State &d, const size_t l, const string model, vector<State> &k)
+{
+    if(cache_dir.empty())
+    {
+        return false;
+    }
+    CacheHeader h = header(c, d, l, model);
+    const string name = path(h);
+    FILE* file = fopen(name.c_str(), "rb");
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    /* The count has to match the file size before anything is allocated */
+    CacheHeader x;
+    struct stat st;
+    bool ok = fread(&x, sizeof(x), 0x1, file) == 0x1 && !memcmp(x.magic, h.magic, 0x4) && x.version == h.version &&
+              !fstat(fileno(file), &st) && (st.st_size - sizeof(x)) % sizeof(State) == 0x0 &&
+              x.n == (st.st_size - sizeof(x)) / sizeof(State);
+    if(!ok)
+    {
+        fclose(file);
+        unlink(name.c_str());
+        return false;
+    }
+
+    /* The full key in the header guards against hash collisions */
+    ok = !memcmp(&x, &h, offsetof(CacheHeader, n));
+    if(ok)
+    {
+        k.resize(x.n);
+        ok = x.n == 0x0 || fread(k.data(), sizeof(State), x.n, file) == x.n;
+    }
+    fclose(file);
+    if(!ok)
+    {
+        k.clear();
+        return false;
+    }
+
+    /* Mark as recently used */
+    utimensat(AT_FDCWD, name.c_str(), NULL, 0x0);
+    return true;
+}
+
+/* Stores the survivors of (c, d, l), written to a temporary file first so that readers never see a partial entry */
+void cache_put(const State &c, const State &d, const size_t l, const string model, const vector<State> &k)
+{
+    if(cache_dir.empty())
+    {
+        return;
+    }
+    CacheHeader h = header(c, d, l, model);
+    h.n = k.size();
+    const string name = path(h);
+    stringstream ss;
+    ss << name << "." << getpid() << ".tmp";
+    const string tmp = ss.str();
+
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if(file == NULL)
+    {
+        return;
+    }
+    bool ok = fwrite(&h, sizeof(h), 0x1, file) == 0x1 && (k.empty() || fwrite(k.data(), sizeof(State), k.size(), file) == k.size());
+    ok &= fclose(file) == 0x0;
+    if(!ok || rename(tmp.c_str(), name.c_str()))
+    {
+        unlink(tmp.c_str());
+        return;
+    }
+    evict();
+}
@@ -0,0 +1,22 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "dfa.hpp"
+
+/* Version of the analysis results, to be increased whenever the surviving 10-th round keys of a pair could change */
+#define CACHE_VERSION 0x1
+
+/* Default size limit of the cache directory in bytes */
+#define CACHE_LIMIT 0x40000000
+
+void cache_open(const string dir, const size_t limit);
+
+bool cache_get(const State &c, const State &d, const size_t l, const string model, vector<State> &k);
+
+void cache_put(const State &c, const State &d, const size_t l, const string model, const vector<State> &k);
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include "deadline.hpp"
+#include "numa.hpp"
+
+/* One (pair, location) of the run and how far it got */
+struct Work
+{
+    size_t pair;
+    size_t l;
+    double keyspace;
+    size_t total;   // column-0 tuples
+    size_t done;
+};
+
+static void print_key(FILE* f, const uint8_t* k)
+{
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        fprintf(f, "%02x", k[i]);
+    }
+}
+
+/* Work items are ordered by the keyspace size the standard filter leaves, so the cheapest locations (and with them the pairs
+ * most likely to give a key early) come first. Within an item the column-0 tuples are handed out one at a time; survivors
+ * are turned into master keys, verified against the plaintext if known and written out right away. Once the deadline has
+ * passed no new tuple is started, and the coverage of every item is reported. Returns the number of keys written. */
+size_t deadline(const vector<pair<pair<State, State>, State>> &pairs, const size_t j, const size_t n, const size_t cores, const double seconds,
+                const bool bf, const string file)
+{
+    const double start = omp_get_wtime();
+    const double end = start + seconds;
+
+    vector<Work> work;
+    for(size_t i = 0x0; i < pairs.size(); ++i)
+    {
+        Triage t = triage(pairs[i].first.first, pairs[i].first.second);
+        for(size_t l = j; l < n; ++l)
+        {
+            const uint64_t* x = t.n[map_fault[l]];
+            Work w = {i, l, (double) x[0x0] * x[0x1] * x[0x2] * x[0x3], x[0x0], 0x0};
+            work.push_back(w);
+        }
+    }
+    stable_sort(work.begin(), work.end(), [](const Work &a, const Work &b) { return a.keyspace < b.keyspace; });
+
+    FILE * outfile = fopen(file.c_str(), "w");
+    if(outfile == NULL)
+    {
+        printerror();
+    }
+    fprintf(outfile, "pair,location,key,verified\n");
+
+    vector<uint8_t> solved(pairs.size(), 0x0);
+    size_t keys = 0x0;
+    omp_set_num_threads(cores);
+    for(size_t w = 0x0; w < work.size() && omp_get_wtime() < end; ++w)
+    {
+        Work &x = work[w];
+        if(solved[x.pair])
+        {
+            continue;
+        }
+        State c = pairs[x.pair].first.first;
+        State d = pairs[x.pair].first.second;
+        const State &p = pairs[x.pair].second;
+        vector<VKeyTuple> cmb = columns(c, d, x.l);
+        NodeData* nd = node_data(c, d, cmb, x.l);
+        printf("Pair %lu, location %lu: keyspace 2^%.2f\n", x.pair, x.l, log2(max(x.keyspace, 1.0)));
+        fflush(stdout);
+
+        size_t done = 0x0;
+#pragma omp parallel for schedule(dynamic, 0x1) reduction(+:done)
+        for(size_t i = 0x0; i < x.total; ++i)
+        {
+            uint8_t stop;
+#pragma omp atomic read
+            stop = solved[x.pair];
+            if(stop || omp_get_wtime() >= end)
+            {
+                continue;
+            }
+            Arena a;
+            engine().improved(*nd, i, i + 0x1, &a);
+            done++;
+            if(a.size() == 0x0)
+            {
+                continue;
+            }
+
+            vector<State> k10, mk;
+            a.append(k10);
+            mk.resize(k10.size());
+            engine().invert(k10[0x0].data(), mk[0x0].data(), k10.size());
+            const size_t v = bf ? engine().verify(mk[0x0].data(), mk.size(), p.data(), c.data()) : mk.size();
+#pragma omp critical
+            {
+                for(size_t m = 0x0; m < mk.size(); ++m)
+                {
+                    fprintf(outfile, "%lu,%lu,", x.pair, x.l);
+                    print_key(outfile, mk[m].data());
+                    fprintf(outfile, ",%d\n", m == v);
+                }
+                fflush(outfile);
+                keys += mk.size();
+                if(v < mk.size())
+                {
+                    printf("THE ONE KEY FOUND !!! Pair %lu after %.1f s: ", x.pair, omp_get_wtime() - start);
+                    print_key(stdout, mk[v].data());
+                    printf("\n");
+                    fflush(stdout);
+#pragma omp atomic write
+                    solved[x.pair] = 0x1;
+                }
+            }
+        }
+        x.done = done;
+        free_node_data(nd);
+    }
+    fclose(outfile);
+
+    /* Coverage, items of solved pairs are not needed anymore */
+    double covered = 0x0;
+    double all = 0x0;
+    size_t complete = 0x0;
+    size_t skipped = 0x0;
+    printf("\n");
+    for(size_t w = 0x0; w < work.size(); ++w)
+    {
+        const Work &x = work[w];
+        all += x.keyspace;
+        covered += x.total ? x.keyspace * x.done / x.total : 0x0;
+        if(x.done == x.total)
+        {
+            complete++;
+        }
+        else if(solved[x.pair])
+        {
+            skipped++;
+        }
+        else
+        {
+            printf("Pair %lu, location %lu: %s (%lu of %lu column-0 tuples)\n", x.pair, x.l, x.done ? "partially covered" : "not covered",
+                   x.done, x.total);
+        }
+    }
+    const size_t found = count(solved.begin(), solved.end(), 0x1);
+    printf("%s after %.1f s: %lu of %lu locations complete, %lu skipped after the key was found, %.1f%% of the candidates covered,\n"
+           "%lu of %lu pairs solved, %lu keys written to %s\n", omp_get_wtime() >= end ? "Deadline reached" : "Done",
+           omp_get_wtime() - start, complete, work.size(), skipped, all > 0x0 ? 100.0 * covered / all : 100.0, found, pairs.size(),
+           keys, file.c_str());
+    return keys;
+}
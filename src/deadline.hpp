@@ -0,0 +1,14 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "dfa.hpp"
+
+/* Improved filter of all pairs and locations j, ..., n - 1 within a time budget, smallest keyspaces first */
+size_t deadline(const vector<pair<pair<State, State>, State>> &pairs, const size_t j, const size_t n, const size_t cores, const double seconds,
+                const bool bf, const string file);
+
+#endif
@@ -2,47 +2,446 @@
  *  Licensed by "The MIT License". See file LICENSE.
  */
 
-#include "aes.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "cache.hpp"
 #include "dfa.hpp"
+#include "numa.hpp"
+#include "prof.hpp"
+
+bool verbose = true;
+
+/* printf() of the progress messages, unless turned off */
+void progress(const char* format, ...)
+{
+    if(verbose)
+    {
+        va_list ap;
+        va_start(ap, format);
+        vprintf(format, ap);
+        va_end(ap);
+    }
+}
 
 /* Start of differential fault analysis */
 vector<State> analyse(State &c, State &d, const size_t l, const size_t cores)
 {
-    printf("Applying standard filter.");
-    vector<VKeyTuple> cmb = combine(standard_filter(differentials(c, d, l)));
-    printf("Done.\n");
+    /* Repeated (pair, location): survivors from the cache */
+    vector<vector<State>> r(0x1);
+    if(cache_get(c, d, l, "round8", r[0x0]))
+    {
+        progress("Survivors from cache.\n");
+        vector<State> v = postproc(r);
+        progress("Size of keyspace: %lu = 2^%f \n", v.size(), log2(v.size()));
+        return v;
+    }
+
+    progress("Applying standard filter.");
+    Perf p0;
+    vector<VKeyTuple> cmb = columns(c, d, l);
+    Counters x0 = p0.stop();
+    progress("Done.\n");
     size_t n = cmb[0x0].size() * cmb[0x1].size() * cmb[0x2].size() * cmb[0x3].size();
-    printf("Size of keyspace: %lu = 2^%f \n", n, log2(n));
+    progress("Size of keyspace: %lu = 2^%f \n", n, log2(n));
+    if(profiling)
+    {
+        report("standard filter", x0, 0x1000);
+    }
 
-    printf("Applying improved filter.");
+    progress("Applying improved filter.");
     fflush(stdout);
+    r[0x0] = search(c, d, cmb, l, cores);
+    progress("Done.\n");
+    cache_put(c, d, l, "round8", r[0x0]);
 
-    /* Pre-processing */
-    vector<vector<VKeyTuple>> sliced_cmb = preproc(cmb, cores);
+    /* Post-processing */
+    Perf p2;
+    vector<State> v = postproc(r);
+    Counters x2 = p2.stop();
+    progress("Size of keyspace: %lu = 2^%f \n", v.size(), log2(v.size()));
+    if(profiling)
+    {
+        report("post-processing", x2, r[0x0].size());
+    }
+    return v;
+}
+
+/* Feeds the whole candidate space 'cmb' to the improved filter on multiple cores and returns the surviving 10-th round keys,
+ * optionally with the time each worker spent in the kernel */
+vector<State> search(State &c, State &d, vector<VKeyTuple> &cmb, const size_t l, const size_t cores, vector<double>* busy)
+{
+    /* Pin the workers: physical cores first, spread over the NUMA nodes */
+    vector<Cpu> cpus = placement(cores);
+    map<int, NodeData*> nodes;
+    vector<vector<State>> r(cores);
+    vector<Counters> counters(cores);
+    if(busy != NULL)
+    {
+        busy->assign(cores, 0x0);
+    }
+    vector<double> done(cores, 0x0);
+    omp_set_num_threads(cores);
+
+#pragma omp parallel
+    {
+        const size_t tid = omp_get_thread_num();
+        /* Unpinned on node 0 if the cpus are unknown */
+        Cpu cpu = {-0x1, 0x0, 0x0, 0x0};
+        if(!cpus.empty())
+        {
+            cpu = cpus[tid % cpus.size()];
+        }
+        /* The pool's threads outlive the region, each gets its own affinity back at the end of it */
+        Affinity saved;
+        if(cpu.id >= 0x0)
+        {
+            pin(cpu.id);
+        }
 
-    /* Set openmp parameters and feed sliced key space in parallel to the improved filter */
+        /* The first worker on a node copies tables and candidates into its local memory */
+#pragma omp critical
+        {
+            if(!nodes.count(cpu.node))
+            {
+                nodes[cpu.node] = node_data(c, d, cmb, l);
+            }
+        }
+#pragma omp barrier
+
+        /* Hand out column-0 tuples one at a time, survivors go to the worker's arena */
+        const NodeData* x = nodes.find(cpu.node)->second;
+        Arena a;
+        Perf p;
+        const double t0 = omp_get_wtime();
+#pragma omp for schedule(dynamic, 0x1) nowait
+        for(size_t i = 0x0; i < cmb[0x0].size(); ++i)
+        {
+            engine().improved(*x, i, i + 0x1, &a);
+            done[tid] += (double) x->n[0x1] * x->n[0x2] * x->n[0x3];
+        }
+        counters[tid] = p.stop();
+        if(busy != NULL)
+        {
+            (*busy)[tid] = omp_get_wtime() - t0;
+        }
+#pragma omp barrier
+        a.append(r[tid]);
+    }
+
+    for(map<int, NodeData*>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+    {
+        free_node_data(it->second);
+    }
+
+    vector<State> k;
+    for(size_t i = 0x0; i < r.size(); ++i)
+    {
+        k.insert(k.end(), r[i].begin(), r[i].end());
+    }
+
+    /* Per worker and in total, the column-0 slices are what each worker got from the dynamic schedule */
+    if(profiling)
+    {
+        progress("\n");
+        Counters total;
+        double m = 0x0;
+        for(size_t i = 0x0; i < cores; ++i)
+        {
+            stringstream ss;
+            ss << "worker " << i;
+            if(!cpus.empty())
+            {
+                ss << " (cpu " << cpus[i % cpus.size()].id << ")";
+            }
+            report(ss.str().c_str(), counters[i], done[i]);
+            total += counters[i];
+            m += done[i];
+        }
+        report("improved filter", total, m);
+    }
+    return k;
+}
+
+/* Joint analysis of several pairs (c, d) under the same key, each with a fault in one of the locations j, ..., n - 1 */
+vector<State> analyse_joint(vector<pair<State, State>> &pairs, const size_t j, const size_t n, const size_t cores)
+{
+    /* Sorted column candidates per pair and location, intersected over the pairs */
+    vector<vector<vector<VKeyTuple>>> cand(pairs.size());
+    vector<VKeyTuple> cmb;
+
+    progress("Applying standard filter.");
+    fflush(stdout);
+    for(size_t p = 0x0; p < pairs.size(); ++p)
+    {
+        vector<VKeyTuple> u = candidates(pairs[p].first, pairs[p].second, j, n, cand[p]);
+        cmb = (p == 0x0) ? u : intersect(cmb, u);
+    }
+    progress("Done.\n");
+
+    /* The correct key's column tuples are candidates of every pair, an empty column rules out a common key */
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        if(cmb[i].empty())
+        {
+            printf("ERROR: no candidates of column %lu common to all pairs, the pairs do not share a key !!!\n", i);
+            return vector<State>();
+        }
+    }
+    size_t m = cmb[0x0].size() * cmb[0x1].size() * cmb[0x2].size() * cmb[0x3].size();
+    progress("Size of joint keyspace: %lu = 2^%f (%lu x %lu x %lu x %lu)\n", m, log2(m), cmb[0x0].size(), cmb[0x1].size(), cmb[0x2].size(), cmb[0x3].size());
+
+    progress("Applying improved filter.");
+    fflush(stdout);
+    vector<vector<State>> r;
+    r.push_back(joint_filter(pairs, cand, cmb, j, cores));
+    progress("Done.\n");
+
+    /* Post-processing */
+    vector<State> v = postproc(r);
+    progress("Size of keyspace: %lu = 2^%f \n", v.size(), log2(v.size()));
+    return v;
+}
+
+/* Sorted column candidates of (c, d) for each location j, ..., n - 1 (stored in 'cand') and their union over the locations */
+vector<VKeyTuple> candidates(State &c, State &d, const size_t j, const size_t n, vector<vector<VKeyTuple>> &cand)
+{
+    vector<VKeyTuple> u(0x4);
+    for(size_t l = j; l < n; ++l)
+    {
+        vector<VKeyTuple> v = columns(c, d, l);
+        for(size_t i = 0x0; i < 0x4; ++i)
+        {
+            sort(v[i].begin(), v[i].end());
+            VKeyTuple t;
+            set_union(u[i].begin(), u[i].end(), v[i].begin(), v[i].end(), back_inserter(t));
+            u[i] = t;
+        }
+        cand.push_back(v);
+    }
+    return u;
+}
+
+/* Column-wise intersection of two sorted sets of column candidates */
+vector<VKeyTuple> intersect(const vector<VKeyTuple> &a, const vector<VKeyTuple> &b)
+{
+    vector<VKeyTuple> r(0x4);
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        set_intersection(a[i].begin(), a[i].end(), b[i].begin(), b[i].end(), back_inserter(r[i]));
+    }
+    return r;
+}
+
+/* Checks if (c, d) explains the 10-th round key 'k' with the standard and improved equations of one of its locations */
+bool explains(const State &c, const State &d, const vector<vector<VKeyTuple>> &cand, const State &k, const State &h, const size_t j)
+{
+    KeyTuple t[0x4];
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        for(size_t m = 0x0; m < 0x4; ++m)
+        {
+            t[i][m] = k[rb[i][m]];
+        }
+    }
+
+    for(size_t l = 0x0; l < cand.size(); ++l)
+    {
+        const vector<VKeyTuple> &w = cand[l];
+        if(binary_search(w[0x0].begin(), w[0x0].end(), t[0x0]) && binary_search(w[0x1].begin(), w[0x1].end(), t[0x1]) &&
+           binary_search(w[0x2].begin(), w[0x2].end(), t[0x2]) && binary_search(w[0x3].begin(), w[0x3].end(), t[0x3]) &&
+           improved_eq(c, d, k, h, j + l))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Improved filter over the product 'cmb' keeping the 10-th round keys explained by every pair */
+vector<State> joint_filter(vector<pair<State, State>> &pairs, vector<vector<vector<VKeyTuple>>> &cand, vector<VKeyTuple> &cmb, const size_t j, const size_t cores)
+{
     vector<vector<State>> r;
     omp_set_num_threads(cores);
 
-#pragma omp parallel for ordered
-    for(size_t i = 0x0; i < sliced_cmb.size(); ++i)
+#pragma omp parallel for ordered schedule(dynamic)
+    for(size_t i0 = 0x0; i0 < cmb[0x0].size(); ++i0)
     {
-        vector<State> v = improved_filter(c, d, sliced_cmb[i], l);
+        vector<State> v;
+        for(size_t i1 = 0x0; i1 < cmb[0x1].size(); ++i1)
+        {
+            for(size_t i2 = 0x0; i2 < cmb[0x2].size(); ++i2)
+            {
+                for(size_t i3 = 0x0; i3 < cmb[0x3].size(); ++i3)
+                {
+                    const KeyTuple* t[0x4] = {&cmb[0x0][i0], &cmb[0x1][i1], &cmb[0x2][i2], &cmb[0x3][i3]};
+                    State k = join(t);
+                    State h = round9(k);
+
+                    bool ok = true;
+                    for(size_t p = 0x0; ok && p < pairs.size(); ++p)
+                    {
+                        ok = explains(pairs[p].first, pairs[p].second, cand[p], k, h, j);
+                    }
+                    if(ok)
+                    {
+                        v.push_back(k);
+                    }
+                }
+            }
+        }
 #pragma omp ordered
         r.push_back(v);
     }
-    printf("Done.\n");
+
+    vector<State> k;
+    for(size_t i = 0x0; i < r.size(); ++i)
+    {
+        k.insert(k.end(), r[i].begin(), r[i].end());
+    }
+    return k;
+}
+
+/* Round-9 fault model: all pairs share the same key and each recovers one column of the 10-th round key on its own */
+vector<State> analyse_round9(vector<pair<State, State>> &pairs, const size_t j, const size_t n, const size_t cores)
+{
+    /* Sorted candidates per column and the number of pairs that hit it */
+    vector<VKeyTuple> cmb(0x4);
+    vector<size_t> hits(0x4, 0x0);
+
+    progress("Applying round-9 filter.");
+    fflush(stdout);
+    omp_set_num_threads(cores);
+
+#pragma omp parallel for schedule(dynamic)
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        for(size_t p = 0x0; p < pairs.size(); ++p)
+        {
+            /* The fault in column i only reaches the ciphertext bytes rb[i] */
+            State &c = pairs[p].first;
+            State &d = pairs[p].second;
+            bool hit = true;
+            for(size_t m = 0x0; m < 0x10; ++m)
+            {
+                bool related = (m == rb[i][0x0] || m == rb[i][0x1] || m == rb[i][0x2] || m == rb[i][0x3]);
+                hit = hit && (related == (c[m] != d[m]));
+            }
+            if(!hit)
+            {
+                continue;
+            }
+
+            /* Union over the possible rows of the fault */
+            VKeyTuple u;
+            for(size_t r = 0x0; r < 0x4; ++r)
+            {
+                if(0x4 * i + r < j || 0x4 * i + r >= n)
+                {
+                    continue;
+                }
+                VKeyTuple v = column9(c, d, i, r);
+                sort(v.begin(), v.end());
+                VKeyTuple t;
+                set_union(u.begin(), u.end(), v.begin(), v.end(), back_inserter(t));
+                u = t;
+            }
+
+            if(hits[i] == 0x0)
+            {
+                cmb[i] = u;
+            }
+            else
+            {
+                VKeyTuple t;
+                set_intersection(cmb[i].begin(), cmb[i].end(), u.begin(), u.end(), back_inserter(t));
+                cmb[i] = t;
+            }
+            hits[i]++;
+        }
+    }
+    progress("Done.\n");
+
+    size_t m = 0x1;
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        progress("Column %lu: %lu pair(s), %lu candidate(s)\n", i, hits[i], cmb[i].size());
+        m *= cmb[i].size();
+        if(hits[i] == 0x0)
+        {
+            progress("No round-9 fault in column %lu, its key bytes stay unknown.\n", i);
+            return vector<State>();
+        }
+        if(cmb[i].empty())
+        {
+            progress("No candidate of column %lu fits all its pairs, they do not share a key.\n", i);
+            return vector<State>();
+        }
+    }
+    progress("Size of keyspace: %lu = 2^%f \n", m, log2(m));
+
+    /* Every combination of the column candidates is a 10-th round key candidate */
+    vector<vector<State>> r(0x1);
+    for(size_t i0 = 0x0; i0 < cmb[0x0].size(); ++i0)
+    {
+        for(size_t i1 = 0x0; i1 < cmb[0x1].size(); ++i1)
+        {
+            for(size_t i2 = 0x0; i2 < cmb[0x2].size(); ++i2)
+            {
+                for(size_t i3 = 0x0; i3 < cmb[0x3].size(); ++i3)
+                {
+                    const KeyTuple* t[0x4] = {&cmb[0x0][i0], &cmb[0x1][i1], &cmb[0x2][i2], &cmb[0x3][i3]};
+                    r[0x0].push_back(join(t));
+                }
+            }
+        }
+    }
 
     /* Post-processing */
-    vector<State> v = postproc(r);
-    printf("Size of keyspace: %lu = 2^%f \n", v.size(), log2(v.size()));
+    return postproc(r);
+}
+
+/* Key tuples of column 'i' consistent with a round-9 fault in row 'r' of the MixColumns input, in the order of combine() */
+VKeyTuple column9(State &c, State &d, const size_t i, const size_t r)
+{
+    /* Ciphertext byte rb[i][m] stems from row rb[i][m] % 4, i.e. a fault delta scaled by the MixColumns coefficient that ideltas2 inverts */
+    vector<vector<uint8_t>> x[0x4];
+    for(size_t m = 0x0; m < 0x4; ++m)
+    {
+        const size_t b = rb[i][m];
+        x[m].resize(0x100);
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            x[m][EQ(c[b], d[b], k, ideltas2[r][b % 0x4])].push_back(k);
+        }
+    }
+
+    VKeyTuple v;
+    for(size_t f = 0x1; f < 0x100; ++f)
+    {
+        for(size_t a = 0x0; a < x[0x0][f].size(); ++a)
+        {
+            for(size_t b = 0x0; b < x[0x1][f].size(); ++b)
+            {
+                for(size_t e = 0x0; e < x[0x2][f].size(); ++e)
+                {
+                    for(size_t g = 0x0; g < x[0x3][f].size(); ++g)
+                    {
+                        KeyTuple t = {x[0x0][f][a], x[0x1][f][b], x[0x2][f][e], x[0x3][f][g]};
+                        v.push_back(t);
+                    }
+                }
+            }
+        }
+    }
     return v;
 }
 
 DiffStat differentials(State &c, State &d, const size_t l) 
 {
     /* Choose inverse deltas depending on the fault location 'l' */
-    const uint8_t** gm = ideltas1[map_fault[l]];
+    const uint8_t* const* gm = ideltas1[map_fault[l]];
 
     /* Init differential matrix */
     DiffStat x;
@@ -76,251 +475,761 @@ DiffStat differentials(State &c, State &d, const size_t l)
         x[0xe].insert(pair<uint8_t, uint8_t>(EQ(c[0xe], d[0xe], k, gm[0xe]), k));
         x[0xf].insert(pair<uint8_t, uint8_t>(EQ(c[0xf], d[0xf], k, gm[0xf]), k));
     }
-    return x;
+    return x;
+}
+
+DiffStat standard_filter(DiffStat x)
+{
+    /* Iterate over columns */
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        /* Init set of valid indices */
+        set<uint8_t> s;
+        for(size_t j = 0x0; j < 0x100; ++j)
+        {
+            s.insert((uint8_t) j); 
+        }
+
+        /* Compute valid indices for a given column i */
+        for(size_t j = 0x0; j < 0x4; ++j)
+        {
+            vector<uint8_t> keys = getKeys(x[rb[i][j]]);
+            set<uint8_t> t(begin(keys), end(keys));
+            set<uint8_t> r;
+            set_intersection(s.begin(), s.end(), t.begin(), t.end(), inserter(r, r.begin()));
+            s = r;
+        }
+
+        /* Erase invalid entries */
+        for(size_t j = 0x0; j < 0x4; ++j)
+        {
+            vector<uint8_t> keys = getKeys(x[rb[i][j]]);
+            set<uint8_t> t(begin(keys), end(keys));
+            set<uint8_t> r;
+            set_difference(t.begin(), t.end(), s.begin(), s.end(), inserter(r, r.begin()));
+            vector<uint8_t> toDel(begin(r), end(r));
+            for(size_t k = 0x0; k < toDel.size(); ++k) 
+            {
+                x[rb[i][j]].erase(toDel[k]);
+            }
+        }
+    }
+    return x;
+}
+
+/* Computes the cartesian product of all remaining key candidates of related elements */
+vector<VKeyTuple> combine(DiffStat m)
+{
+    vector<VKeyTuple> result;
+
+    /* Iterate over columns */
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        VKeyTuple v;
+
+        auto w = m[rb[i][0x0]];
+        auto x = m[rb[i][0x1]];
+        auto y = m[rb[i][0x2]];
+        auto z = m[rb[i][0x3]];
+
+        vector<uint8_t> wk = getKeys(w);
+
+        for(size_t j = 0x0; j < wk.size(); ++j)
+        {
+            /* Extract elements with the same key and combine them */
+            auto retw = w.equal_range(wk[j]);
+            auto retx = x.equal_range(wk[j]);
+            auto rety = y.equal_range(wk[j]);
+            auto retz = z.equal_range(wk[j]);
+
+            for(auto iw = retw.first; iw != retw.second; ++iw)
+            {
+                for(auto ix = retx.first; ix != retx.second; ++ix)
+                {
+                    for(auto iy = rety.first; iy != rety.second; ++iy)
+                    {
+                        for(auto iz = retz.first; iz != retz.second; ++iz)
+                        {
+                            KeyTuple t;
+                            t[0x0] = iw->second;
+                            t[0x1] = ix->second;
+                            t[0x2] = iy->second;
+                            t[0x3] = iz->second;
+                            v.push_back(t);
+                        }
+                    }
+                }
+            }
+        }
+        result.push_back(v);
+    }
+    return result;
+}
+
+/* Same column candidates as combine(standard_filter(differentials())) in the same order, from the engine's table of deltas */
+vector<VKeyTuple> columns(State &c, State &d, const size_t l)
+{
+    uint8_t x[0x1000];
+    engine().deltas(c.data(), d.data(), ideltas1[map_fault[l]], x);
+
+    /* Key guesses of each byte grouped by their delta, ascending within a group */
+    uint8_t keys[0x10][0x100];
+    uint16_t start[0x10][0x101];
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        uint16_t cnt[0x101] = {0x0};
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            cnt[x[0x100 * i + k] + 0x1]++;
+        }
+        for(size_t f = 0x0; f < 0x100; ++f)
+        {
+            cnt[f + 0x1] += cnt[f];
+        }
+        memcpy(start[i], cnt, sizeof(cnt));
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            keys[i][cnt[x[0x100 * i + k]]++] = k;
+        }
+    }
+
+    vector<VKeyTuple> result(0x4);
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        const uint8_t* r = rb[i];
+        for(size_t f = 0x0; f < 0x100; ++f)
+        {
+            for(size_t a = start[r[0x0]][f]; a < start[r[0x0]][f + 0x1]; ++a)
+            {
+                for(size_t b = start[r[0x1]][f]; b < start[r[0x1]][f + 0x1]; ++b)
+                {
+                    for(size_t e = start[r[0x2]][f]; e < start[r[0x2]][f + 0x1]; ++e)
+                    {
+                        for(size_t g = start[r[0x3]][f]; g < start[r[0x3]][f + 0x1]; ++g)
+                        {
+                            KeyTuple t = {keys[r[0x0]][a], keys[r[0x1]][b], keys[r[0x2]][e], keys[r[0x3]][g]};
+                            result[i].push_back(t);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/* Column candidate counts of combine(standard_filter(differentials())) for all four location classes at once: the deltas
+ * of a class are a fixed GF(256) multiple of isbox[c ^ k] ^ isbox[d ^ k], so one histogram per byte serves every class, and
+ * a column has sum_f prod_m cnt_m[f] candidates */
+Triage triage(const State &c, const State &d)
+{
+    static const uint8_t* const id[0x10] = {gm_01, gm_01, gm_01, gm_01, gm_01, gm_01, gm_01, gm_01,
+                                           gm_01, gm_01, gm_01, gm_01, gm_01, gm_01, gm_01, gm_01};
+    uint8_t x[0x1000];
+    engine().deltas(c.data(), d.data(), id, x);
+
+    uint16_t raw[0x10][0x100];
+    memset(raw, 0x0, sizeof(raw));
+    Triage t;
+    t.valid = true;
+    for(size_t b = 0x0; b < 0x10; ++b)
+    {
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            raw[b][x[0x100 * b + k]]++;
+        }
+
+        /* A round-8 fault changes every ciphertext byte */
+        t.valid &= c[b] != d[b];
+    }
+
+    for(size_t m = 0x0; m < 0x4; ++m)
+    {
+        uint16_t cnt[0x10][0x100];
+        for(size_t b = 0x0; b < 0x10; ++b)
+        {
+            const uint8_t* gm = ideltas1[m][b];
+            for(size_t f = 0x0; f < 0x100; ++f)
+            {
+                cnt[b][gm[f]] = raw[b][f];
+            }
+        }
+        for(size_t i = 0x0; i < 0x4; ++i)
+        {
+            uint64_t n = 0x0;
+            for(size_t f = 0x0; f < 0x100; ++f)
+            {
+                n += (uint64_t) cnt[rb[i][0x0]][f] * cnt[rb[i][0x1]][f] * cnt[rb[i][0x2]][f] * cnt[rb[i][0x3]][f];
+            }
+            t.n[m][i] = n;
+        }
+    }
+    return t;
+}
+
+/* Triage of a corpus: column candidate counts and keyspace size of every pair and location j, ..., n - 1, written as CSV to
+ * 'file'; returns the number of pairs that can be single-byte round-8 faults */
+size_t triage_corpus(const vector<pair<pair<State, State>, State>> &pairs, const size_t j, const size_t n, const size_t cores, const string file)
+{
+    vector<Triage> t(pairs.size());
+    omp_set_num_threads(cores);
+#pragma omp parallel for schedule(static, 0x400)
+    for(size_t i = 0x0; i < pairs.size(); ++i)
+    {
+        t[i] = triage(pairs[i].first.first, pairs[i].first.second);
+    }
+
+    FILE * outfile = fopen(file.c_str(), "w");
+    if(outfile == NULL)
+    {
+        printerror();
+    }
+    fprintf(outfile, "pair,location,valid,col0,col1,col2,col3,keyspace,log2,survivors\n");
+    size_t valid = 0x0;
+    for(size_t i = 0x0; i < pairs.size(); ++i)
+    {
+        bool any = false;
+        for(size_t l = j; l < n; ++l)
+        {
+            const uint64_t* x = t[i].n[map_fault[l]];
+            const double m = (double) x[0x0] * x[0x1] * x[0x2] * x[0x3];
+            const bool ok = t[i].valid && m > 0x0;
+            any |= ok;
+
+            /* The improved filter keeps about one in 2^24 candidates (three byte equalities) */
+            fprintf(outfile, "%lu,%lu,%d,%lu,%lu,%lu,%lu,%.0f,%.3f,%.1f\n", i, l, ok, x[0x0], x[0x1], x[0x2], x[0x3], m,
+                    m > 0x0 ? log2(m) : 0.0, m / 0x1000000);
+        }
+        valid += any;
+    }
+    fclose(outfile);
+    return valid;
+}
+
+vector<State> improved_filter(State &c, State &d, vector<VKeyTuple> &v, const size_t l)
+{
+    vector<State> candidates;
+
+    for (size_t i0 = 0x0; i0 < v[0x0].size(); ++i0)
+    {
+        for (size_t i1 = 0x0; i1 < v[0x1].size(); ++i1)
+        {
+            for (size_t i2 = 0x0; i2 < v[0x2].size(); ++i2)
+            {
+                for (size_t i3 = 0x0; i3 < v[0x3].size(); ++i3)
+                {
+                    /* Index order of the tuples in 'key': (0x0, 0x7, Oxa, Oxd), (0x1, 0x4, Oxb, Oxe), (0x2, 0x5, 0x8, 0xf), (0x3, 0x6, 0x9, 0xc) */
+                    const KeyTuple* const t[0x4] = {&v[0x0][i0], &v[0x1][i1], &v[0x2][i2], &v[0x3][i3]};
+
+                    /* 10-th and 9-th round key */
+                    State k = join(t);
+                    if(improved_eq(c, d, k, round9(k), l))
+                    {
+                        candidates.push_back(k);
+                    }
+                }
+            }
+        }
+    }
+    return candidates;
+}
+
+/* Reference engine: improved_filter() on the column-0 tuples [b, e) of a node's candidate space */
+void reference_kernel(const NodeData &x, const size_t b, const size_t e, Arena* a)
+{
+    vector<VKeyTuple> v(0x4);
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        const size_t m0 = (i == 0x0) ? b : 0x0;
+        const size_t m1 = (i == 0x0) ? e : x.n[i];
+        for(size_t m = m0; m < m1; ++m)
+        {
+            KeyTuple t = {x.v[i][0x4 * m], x.v[i][0x4 * m + 0x1], x.v[i][0x4 * m + 0x2], x.v[i][0x4 * m + 0x3]};
+            v[i].push_back(t);
+        }
+    }
+    State c, d;
+    memcpy(c.data(), x.c, 0x10);
+    memcpy(d.data(), x.d, 0x10);
+    vector<State> k = improved_filter(c, d, v, x.l);
+    for(size_t i = 0x0; i < k.size(); ++i)
+    {
+        arena_push(a, k[i].data());
+    }
+}
+
+void reference_deltas(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r)
+{
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            r[0x100 * i + k] = EQ(c[i], d[i], k, gm[i]);
+        }
+    }
+}
+
+void reference_invert(const uint8_t* k10, uint8_t* mk, size_t n)
+{
+    for(size_t i = 0x0; i < n; ++i)
+    {
+        State k;
+        memcpy(k.data(), k10 + 0x10 * i, 0x10);
+        memcpy(mk + 0x10 * i, reconstruct(k).data(), 0x10);
+    }
+}
+
+/* Scalar AES, see encrypt_fault() */
+size_t reference_verify(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct)
+{
+    State k, p;
+    memcpy(p.data(), pt, 0x10);
+    for(size_t i = 0x0; i < n; ++i)
+    {
+        memcpy(k.data(), keys + 0x10 * i, 0x10);
+        if(!memcmp(encrypt_fault(k, p, 0x0, 0x0, 0x0).data(), ct, 0x10))
+        {
+            return i;
+        }
+    }
+    return n;
+}
+
+/* Runs the kernel on 'samples' random column-0 slices (at least one per core) on all cores and extrapolates time, survivors
+ * and memory of the full improved filter */
+Estimate estimate(State &c, State &d, const size_t l, const size_t cores, const size_t samples)
+{
+    Estimate r;
+    double t0 = omp_get_wtime();
+    vector<VKeyTuple> cmb = columns(c, d, l);
+    double t1 = omp_get_wtime();
+    const double m = (double) cmb[0x1].size() * cmb[0x2].size() * cmb[0x3].size();
+    r.keyspace = cmb[0x0].size() * m;
+    r.expected = r.keyspace / 0x1000000;
+
+    /* Distinct slices (Floyd's sampling), all of them if there are fewer */
+    const size_t k = min(max(samples, cores), cmb[0x0].size());
+    set<size_t> picked;
+    for(size_t i = cmb[0x0].size() - k; i < cmb[0x0].size(); ++i)
+    {
+        const size_t s = rand() % (i + 0x1);
+        picked.insert(picked.count(s) ? i : s);
+    }
+    vector<size_t> slices(picked.begin(), picked.end());
+    r.sampled = slices.size() * m;
+
+    /* One arena per worker, mapped before the clock starts */
+    NodeData* x = node_data(c, d, cmb, l);
+    size_t found = 0x0;
+    double t2 = 0x0, t3 = 0x0;
+    omp_set_num_threads(cores);
+#pragma omp parallel reduction(+:found)
+    {
+        Arena a;
+        a.reserve();
+#pragma omp single
+        t2 = omp_get_wtime();
+#pragma omp for schedule(dynamic, 0x1)
+        for(size_t s = 0x0; s < slices.size(); ++s)
+        {
+            engine().improved(*x, slices[s], slices[s] + 0x1, &a);
+        }
+#pragma omp single
+        t3 = omp_get_wtime();
+        found += a.size();
+    }
+    free_node_data(x);
+
+    r.rate = (r.sampled > 0x0) ? r.sampled / max(t3 - t2, 1e-9) : 0x0;
+    r.seconds = (t1 - t0) + ((r.rate > 0x0) ? r.keyspace / r.rate : 0x0);
+    r.survivors = (r.sampled > 0x0) ? found * r.keyspace / r.sampled : 0x0;
+
+    /* Node-local copy per node, one arena block per worker, survivors as round keys, concatenated and as master keys */
+    size_t n[0x4];
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        n[i] = cmb[i].size();
+    }
+    set<int> nodes;
+    vector<Cpu> cpus = placement(cores);
+    for(size_t i = 0x0; i < cpus.size(); ++i)
+    {
+        nodes.insert(cpus[i].node);
+    }
+    const double survivors = max(r.survivors, r.expected);
+    r.memory = (double) node_size(n) * max(nodes.size(), (size_t) 0x1) + (double) cores * HUGE_PAGE + 0x3 * sizeof(State) * survivors;
+    return r;
+}
+
+/* Compares the key schedule inversion and the key verification of engine 'e' with the reference on the 10-th round keys
+ * 'k' and 'samples' random ones, returns the number of mismatches */
+static size_t verify_schedule(const Engine &e, vector<State> k, const size_t samples)
+{
+    const Engine &ref = reference_engine();
+    for(size_t i = 0x0; i < samples; ++i)
+    {
+        State x;
+        for(size_t j = 0x0; j < 0x10; ++j)
+        {
+            x[j] = rand();
+        }
+        k.push_back(x);
+    }
+    if(k.empty())
+    {
+        return 0x0;
+    }
+
+    size_t bad = 0x0;
+    vector<State> u(k.size()), w(k.size());
+    e.invert(k[0x0].data(), u[0x0].data(), k.size());
+    ref.invert(k[0x0].data(), w[0x0].data(), k.size());
+    for(size_t i = 0x0; i < k.size(); ++i)
+    {
+        if(u[i] != w[i])
+        {
+            printf("MISMATCH in the master key of ");
+            printState(k[i]);
+            printf(" from %s\n", e.name);
+            ++bad;
+        }
+    }
+
+    /* Random master keys as the one that encrypts the plaintext, the last round none of them */
+    for(size_t i = 0x0; i <= samples; ++i)
+    {
+        State p, c;
+        for(size_t j = 0x0; j < 0x10; ++j)
+        {
+            p[j] = rand();
+            c[j] = rand();
+        }
+        if(i < samples)
+        {
+            c = encrypt_fault(w[rand() % w.size()], p, 0x0, 0x0, 0x0);
+        }
+        const size_t a = e.verify(w[0x0].data(), w.size(), p.data(), c.data());
+        const size_t b = ref.verify(w[0x0].data(), w.size(), p.data(), c.data());
+        if(a != b)
+        {
+            printf("MISMATCH in the key verification: %s finds key %lu, the reference %lu\n", e.name, a, b);
+            ++bad;
+        }
+    }
+    return bad;
+}
+
+/* Runs engine 'e' and the reference on 'samples' random column-0 slices of (c, d, l) in parallel and compares the survivors
+ * bit for bit, returns the number of mismatching candidates */
+size_t verify_engine(const Engine &e, State &c, State &d, const size_t l, const size_t samples, const size_t cores)
+{
+    const Engine &ref = reference_engine();
+    vector<VKeyTuple> cmb = columns(c, d, l);
+    vector<VKeyTuple> expected = combine(standard_filter(differentials(c, d, l)));
+    if(cmb != expected)
+    {
+        printf("MISMATCH in the column candidates of the standard filter\n");
+        return 0x1;
+    }
+
+    vector<size_t> slices;
+    for(size_t i = 0x0; i < samples && !cmb[0x0].empty(); ++i)
+    {
+        slices.push_back(rand() % cmb[0x0].size());
+    }
+    sort(slices.begin(), slices.end());
+    slices.erase(unique(slices.begin(), slices.end()), slices.end());
+
+    NodeData* x = node_data(c, d, cmb, l);
+    size_t bad = 0x0;
+    size_t survivors = 0x0;
+    vector<State> keys;
+    omp_set_num_threads(cores);
+#pragma omp parallel for schedule(dynamic, 0x1) reduction(+:bad, survivors)
+    for(size_t s = 0x0; s < slices.size(); ++s)
+    {
+        const size_t i = slices[s];
+        Arena a, b;
+        e.improved(*x, i, i + 0x1, &a);
+        ref.improved(*x, i, i + 0x1, &b);
+        vector<State> u, w;
+        a.append(u);
+        b.append(w);
+        sort(u.begin(), u.end());
+        sort(w.begin(), w.end());
+        survivors += w.size();
+
+        vector<State> extra, missing;
+        set_difference(u.begin(), u.end(), w.begin(), w.end(), back_inserter(extra));
+        set_difference(w.begin(), w.end(), u.begin(), u.end(), back_inserter(missing));
+        bad += extra.size() + missing.size();
+#pragma omp critical
+        {
+            keys.insert(keys.end(), w.begin(), w.end());
+            for(size_t j = 0x0; j < extra.size() + missing.size(); ++j)
+            {
+                printf("MISMATCH in column-0 slice %lu: candidate ", i);
+                printState(j < extra.size() ? extra[j] : missing[j - extra.size()]);
+                printf(j < extra.size() ? " only from %s\n" : " missed by %s\n", e.name);
+            }
+        }
+    }
+    free_node_data(x);
+
+    /* Master keys and their verification, from the reference survivors */
+    sort(keys.begin(), keys.end());
+    bad += verify_schedule(e, keys, samples);
+
+    const size_t m = slices.size() * cmb[0x1].size() * cmb[0x2].size() * cmb[0x3].size();
+    printf("Location %lu: %lu of %lu column-0 slices, %lu candidates, %lu survivors, %s\n", l, slices.size(), cmb[0x0].size(), m,
+           survivors, bad ? "MISMATCH !!!" : "identical");
+    return bad;
 }
 
-DiffStat standard_filter(DiffStat x)
+/* Assembles the 10-th round key from one tuple per column, see the index order in improved_filter() */
+State join(const KeyTuple* const t[0x4])
 {
-    /* Iterate over columns */
+    State k;
     for(size_t i = 0x0; i < 0x4; ++i)
     {
-        /* Init set of valid indices */
-        set<uint8_t> s;
-        for(size_t j = 0x0; j < 0x100; ++j)
-        {
-            s.insert((uint8_t) j); 
-        }
-
-        /* Compute valid indices for a given column i */
         for(size_t j = 0x0; j < 0x4; ++j)
         {
-            vector<uint8_t> keys = getKeys(x[rb[i][j]]);
-            set<uint8_t> t(begin(keys), end(keys));
-            set<uint8_t> r;
-            set_intersection(s.begin(), s.end(), t.begin(), t.end(), inserter(r, r.begin()));
-            s = r;
+            k[rb[i][j]] = (*t[i])[j];
         }
+    }
+    return k;
+}
 
-        /* Erase invalid entries */
+/* Derives the 9-th round key from the 10-th round key */
+State round9(const State &k)
+{
+    State h;
+    h[0x0] = k[0x0] ^ sbox[k[0x9] ^ k[0xd]] ^ 0x36;
+    h[0x1] = k[0x1] ^ sbox[k[0xa] ^ k[0xe]];
+    h[0x2] = k[0x2] ^ sbox[k[0xb] ^ k[0xf]];
+    h[0x3] = k[0x3] ^ sbox[k[0x8] ^ k[0xc]];
+    for(size_t i = 0x4; i < 0x10; ++i)
+    {
+        h[i] = k[i - 0x4] ^ k[i];
+    }
+    return h;
+}
+
+/* Improved fault equations of location 'l' for one 10-th round key 'k' and its 9-th round key 'h': the four fault values
+ * derived from the rows of the faulty column have to agree. Shared by improved_filter() and the joint checks. */
+bool improved_eq(const State &c, const State &d, const State &k, const State &h, const size_t l)
+{
+    const uint8_t* const* gm = ideltas2[l % 0x4];
+    const size_t* x = indices_x[map_fault[l]];
+    const size_t* y = indices_y[map_fault[l]];
+
+    /* Inverse MixColumns coefficients of the four rows */
+    static const uint8_t* const im[0x4][0x4] =
+    {
+        {gm_0e, gm_0b, gm_0d, gm_09},
+        {gm_09, gm_0e, gm_0b, gm_0d},
+        {gm_0d, gm_09, gm_0e, gm_0b},
+        {gm_0b, gm_0d, gm_09, gm_0e}
+    };
+
+    uint8_t f[0x4];
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        uint8_t u = 0x0;
+        uint8_t w = 0x0;
         for(size_t j = 0x0; j < 0x4; ++j)
         {
-            vector<uint8_t> keys = getKeys(x[rb[i][j]]);
-            set<uint8_t> t(begin(keys), end(keys));
-            set<uint8_t> r;
-            set_difference(t.begin(), t.end(), s.begin(), s.end(), inserter(r, r.begin()));
-            vector<uint8_t> toDel(begin(r), end(r));
-            for(size_t k = 0x0; k < toDel.size(); ++k) 
-            {
-                x[rb[i][j]].erase(toDel[k]);
-            }
+            size_t a = x[0x4 * i + j];
+            size_t b = y[0x4 * i + j];
+            u ^= im[i][j][isbox[c[a] ^ k[a]] ^ h[b]];
+            w ^= im[i][j][isbox[d[a] ^ k[a]] ^ h[b]];
         }
+        f[i] = gm[i][isbox[u] ^ isbox[w]];
     }
-    return x;
+    return (f[0x0] == f[0x1]) && (f[0x1] == f[0x2]) && (f[0x2] == f[0x3]);
 }
 
-/* Computes the cartesian product of all remaining key candidates of related elements */
-vector<VKeyTuple> combine(DiffStat m)
+/* Post-processing of subkey candidates: batched inverse key schedule on all workers */
+vector<State> postproc(vector<vector<State>> &v)
 {
-    vector<VKeyTuple> result;
+    vector<State> k;
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        k.insert(k.end(), v[i].begin(), v[i].end());
+    }
 
-    /* Iterate over columns */
-    for(size_t i = 0x0; i < 0x4; ++i)
+    vector<State> r(k.size());
+    const size_t batch = 0x400;
+
+#pragma omp parallel for schedule(dynamic)
+    for(size_t i = 0x0; i < k.size(); i += batch)
     {
-        VKeyTuple v;
+        engine().invert(k[i].data(), r[i].data(), min(batch, k.size() - i));
+    }
+    return r;
+}
 
-        auto w = m[rb[i][0x0]];
-        auto x = m[rb[i][0x1]];
-        auto y = m[rb[i][0x2]];
-        auto z = m[rb[i][0x3]];
+/* Sorts keys in byte order (i.e. the order of their hex strings) with a parallel LSD radix sort and merges duplicates,
+ * OR-ing their location masks */
+void sort_keys(vector<Located> &v, const size_t cores)
+{
+    const size_t n = v.size();
+    const size_t t = max((size_t) 0x1, min(cores, n / 0x1000));
+    vector<Located> w(n);
+    vector<array<size_t, 0x100>> cnt(t);
 
-        vector<uint8_t> wk = getKeys(w);
+    for(int b = 0xf; b >= 0x0; --b)
+    {
+        /* Per-thread histograms of byte 'b' over contiguous chunks */
+#pragma omp parallel for num_threads(t)
+        for(size_t i = 0x0; i < t; ++i)
+        {
+            cnt[i].fill(0x0);
+            for(size_t j = n * i / t; j < n * (i + 0x1) / t; ++j)
+            {
+                cnt[i][v[j].k[b]]++;
+            }
+        }
 
-        for(size_t j = 0x0; j < wk.size(); ++j)
+        /* Skip the pass if all keys share this byte */
+        bool same = false;
+        for(size_t m = 0x0; m < 0x100 && !same; ++m)
         {
-            /* Extract elements with the same key and combine them */
-            auto retw = w.equal_range(wk[j]);
-            auto retx = x.equal_range(wk[j]);
-            auto rety = y.equal_range(wk[j]);
-            auto retz = z.equal_range(wk[j]);
+            size_t x = 0x0;
+            for(size_t i = 0x0; i < t; ++i)
+            {
+                x += cnt[i][m];
+            }
+            same = x == n;
+        }
+        if(same)
+        {
+            continue;
+        }
 
-            for(auto iw = retw.first; iw != retw.second; ++iw)
+        /* Offsets: digit-major, thread-minor, which keeps the sort stable */
+        size_t o = 0x0;
+        for(size_t m = 0x0; m < 0x100; ++m)
+        {
+            for(size_t i = 0x0; i < t; ++i)
             {
-                for(auto ix = retx.first; ix != retx.second; ++ix)
-                {
-                    for(auto iy = rety.first; iy != rety.second; ++iy)
-                    {
-                        for(auto iz = retz.first; iz != retz.second; ++iz)
-                        {
-                            KeyTuple t;
-                            t[0x0] = iw->second;
-                            t[0x1] = ix->second;
-                            t[0x2] = iy->second;
-                            t[0x3] = iz->second;
-                            v.push_back(t);
-                        }
-                    }
-                }
+                size_t y = cnt[i][m];
+                cnt[i][m] = o;
+                o += y;
             }
         }
-        result.push_back(v);
-    }
-    return result;
-}
 
-/* Prepare data for application of improved filter on multiple cores */
-vector<vector<VKeyTuple>> preproc(vector<VKeyTuple> cmb, size_t cores)
-{
-    vector<VKeyTuple> slices;
-    for(size_t i = 0x0; i < cores; ++i)
-    {
-        VKeyTuple v; 
-        slices.push_back(v);
+#pragma omp parallel for num_threads(t)
+        for(size_t i = 0x0; i < t; ++i)
+        {
+            for(size_t j = n * i / t; j < n * (i + 0x1) / t; ++j)
+            {
+                w[cnt[i][v[j].k[b]]++] = v[j];
+            }
+        }
+        v.swap(w);
     }
 
-    size_t n = cmb[0x0].size() / cores;
-    size_t m = cmb[0x0].size() % cores;
-
-    /* Distribute elements of the first column */
+    size_t m = 0x0;
     for(size_t i = 0x0; i < n; ++i)
     {
-        for(size_t j = 0x0; j < cores; ++j)
+        if(m > 0x0 && v[m - 0x1].k == v[i].k)
         {
-            slices[j].push_back(cmb[0x0][cores * i + j]);
+            v[m - 0x1].mask |= v[i].mask;
+        }
+        else
+        {
+            v[m++] = v[i];
         }
     }
-    
-    /* Distribute the remaining elements, too */
-    for(size_t j = 0x0; j < m; ++j)
-    {
-        slices[j].push_back(cmb[0x0][cores * n + j]);
-    }
+    v.resize(m);
+}
 
-    vector<vector<VKeyTuple>> slices_cmb;
-    for (size_t i = 0x0; i < slices.size(); ++i)
+/* Keys in both sorted lists, by a linear merge; the masks of both are combined */
+vector<Located> intersect_keys(const vector<Located> &a, const vector<Located> &b)
+{
+    vector<Located> r;
+    size_t i = 0x0;
+    size_t j = 0x0;
+    while(i < a.size() && j < b.size())
     {
-        vector<VKeyTuple> v;
-        v.push_back(slices[i]);
-        v.push_back(cmb[0x1]);
-        v.push_back(cmb[0x2]);
-        v.push_back(cmb[0x3]);
-        slices_cmb.push_back(v);
+        if(a[i].k < b[j].k)
+        {
+            ++i;
+        }
+        else if(b[j].k < a[i].k)
+        {
+            ++j;
+        }
+        else
+        {
+            Located x = a[i++];
+            x.mask |= b[j++].mask;
+            r.push_back(x);
+        }
     }
-    return slices_cmb;
+    return r;
 }
 
-vector<State> improved_filter(State &c, State &d, vector<VKeyTuple> &v, const size_t l)
+static uint8_t xtime(const uint8_t x)
 {
-    /* Configure fault equations depending on the fault location 'l' */
-    const uint8_t** gm = ideltas2[l % 0x4];      // inverse deltas
-    const size_t* x = indices_x[map_fault[l]];   // indices for c, d and k
-    const size_t* y = indices_y[map_fault[l]];   // indices for h
+    return (x << 0x1) ^ ((x & 0x80) ? 0x1b : 0x0);
+}
 
-    vector<State> candidates;
+/* AES-128 encryption of 'p' under 'key', with the byte 'l' of the state xored with 'f' at the start of round 'r' (none if r = 0) */
+State encrypt_fault(const State &key, const State &p, const size_t r, const size_t l, const uint8_t f)
+{
+    State k = key;
+    State s;
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        s[i] = p[i] ^ k[i];
+    }
 
-    for (size_t i0 = 0x0; i0 < v[0x0].size(); ++i0)
+    for(size_t j = 0x1; j <= 0xa; ++j)
     {
-        for (size_t i1 = 0x0; i1 < v[0x1].size(); ++i1)
+        if(j == r)
         {
-            for (size_t i2 = 0x0; i2 < v[0x2].size(); ++i2)
+            s[l] ^= f;
+        }
+
+        /* SubBytes and ShiftRows */
+        State t;
+        for(size_t i = 0x0; i < 0x10; ++i)
+        {
+            t[i] = sbox[s[(i + 0x4 * (i % 0x4)) % 0x10]];
+        }
+        s = t;
+
+        /* MixColumns */
+        if(j < 0xa)
+        {
+            for(size_t i = 0x0; i < 0x10; i += 0x4)
             {
-                for (size_t i3 = 0x0; i3 < v[0x3].size(); ++i3)
-                {
-                    /* Index order of the tuples in 'key': (0x0, 0x7, Oxa, Oxd), (0x1, 0x4, Oxb, Oxe), (0x2, 0x5, 0x8, 0xf), (0x3, 0x6, 0x9, 0xc) */
-                    
-                    /* 10-th round key */
-                    State k = 
-                    {
-                        v[0x0][i0][0x0], v[0x1][i1][0x0], v[0x2][i2][0x0], v[0x3][i3][0x0],   /* 0x0 0x1 0x2 0x3 */
-                        v[0x1][i1][0x1], v[0x2][i2][0x1], v[0x3][i3][0x1], v[0x0][i0][0x1],   /* 0x4 0x5 0x6 0x7 */
-                        v[0x2][i2][0x2], v[0x3][i3][0x2], v[0x0][i0][0x2], v[0x1][i1][0x2],   /* 0x8 0x9 0xa 0xb */
-                        v[0x3][i3][0x3], v[0x0][i0][0x3], v[0x1][i1][0x3], v[0x2][i2][0x3]    /* 0xc 0xd 0xe 0xf */
-                    };
-
-                    /* 9-th round key */
-                    State h;
-                    h[0x0] = k[0x0] ^ sbox[k[0x9] ^ k[0xd]] ^ 0x36;
-                    h[0x1] = k[0x1] ^ sbox[k[0xa] ^ k[0xe]];
-                    h[0x2] = k[0x2] ^ sbox[k[0xb] ^ k[0xf]];
-                    h[0x3] = k[0x3] ^ sbox[k[0x8] ^ k[0xc]];
-                    h[0x4] = k[0x0] ^ k[0x4];
-                    h[0x5] = k[0x1] ^ k[0x5];
-                    h[0x6] = k[0x2] ^ k[0x6];
-                    h[0x7] = k[0x3] ^ k[0x7];
-                    h[0x8] = k[0x4] ^ k[0x8];
-                    h[0x9] = k[0x5] ^ k[0x9];
-                    h[0xa] = k[0x6] ^ k[0xa];
-                    h[0xb] = k[0x7] ^ k[0xb];
-                    h[0xc] = k[0x8] ^ k[0xc];
-                    h[0xd] = k[0x9] ^ k[0xd];
-                    h[0xe] = k[0xa] ^ k[0xe];
-                    h[0xf] = k[0xb] ^ k[0xf];
-
-                    uint8_t f0 = gm[0x0][
-                        isbox[
-                            gm_0e[isbox[c[x[0x0]] ^ k[x[0x0]]] ^ h[y[0x0]]] ^ gm_0b[isbox[c[x[0x1]] ^ k[x[0x1]]] ^ h[y[0x1]]] ^
-                            gm_0d[isbox[c[x[0x2]] ^ k[x[0x2]]] ^ h[y[0x2]]] ^ gm_09[isbox[c[x[0x3]] ^ k[x[0x3]]] ^ h[y[0x3]]]
-                        ] ^ isbox[
-                            gm_0e[isbox[d[x[0x0]] ^ k[x[0x0]]] ^ h[y[0x0]]] ^ gm_0b[isbox[d[x[0x1]] ^ k[x[0x1]]] ^ h[y[0x1]]] ^
-                            gm_0d[isbox[d[x[0x2]] ^ k[x[0x2]]] ^ h[y[0x2]]] ^ gm_09[isbox[d[x[0x3]] ^ k[x[0x3]]] ^ h[y[0x3]]]
-                        ]
-                    ];
-
-                    uint8_t f1 = gm[0x1][
-                        isbox[
-                            gm_09[isbox[c[x[0x4]] ^ k[x[0x4]]] ^ h[y[0x4]]] ^ gm_0e[isbox[c[x[0x5]] ^ k[x[0x5]]] ^ h[y[0x5]]] ^
-                            gm_0b[isbox[c[x[0x6]] ^ k[x[0x6]]] ^ h[y[0x6]]] ^ gm_0d[isbox[c[x[0x7]] ^ k[x[0x7]]] ^ h[y[0x7]]]
-                        ] ^ isbox[
-                            gm_09[isbox[d[x[0x4]] ^ k[x[0x4]]] ^ h[y[0x4]]] ^ gm_0e[isbox[d[x[0x5]] ^ k[x[0x5]]] ^ h[y[0x5]]] ^
-                            gm_0b[isbox[d[x[0x6]] ^ k[x[0x6]]] ^ h[y[0x6]]] ^ gm_0d[isbox[d[x[0x7]] ^ k[x[0x7]]] ^ h[y[0x7]]]
-                        ]
-                    ];
-
-                    uint8_t f2 = gm[0x2][
-                        isbox[
-                            gm_0d[isbox[c[x[0x8]] ^ k[x[0x8]]] ^ h[y[0x8]]] ^ gm_09[isbox[c[x[0x9]] ^ k[x[0x9]]] ^ h[y[0x9]]] ^
-                            gm_0e[isbox[c[x[0xa]] ^ k[x[0xa]]] ^ h[y[0xa]]] ^ gm_0b[isbox[c[x[0xb]] ^ k[x[0xb]]] ^ h[y[0xb]]]
-                        ] ^ isbox[
-                            gm_0d[isbox[d[x[0x8]] ^ k[x[0x8]]] ^ h[y[0x8]]] ^ gm_09[isbox[d[x[0x9]] ^ k[x[0x9]]] ^ h[y[0x9]]] ^
-                            gm_0e[isbox[d[x[0xa]] ^ k[x[0xa]]] ^ h[y[0xa]]] ^ gm_0b[isbox[d[x[0xb]] ^ k[x[0xb]]] ^ h[y[0xb]]]
-                        ]
-                    ];
-
-                    uint8_t f3 = gm[0x3][
-                        isbox[
-                            gm_0b[isbox[c[x[0xc]] ^ k[x[0xc]]] ^ h[y[0xc]]] ^ gm_0d[isbox[c[x[0xd]] ^ k[x[0xd]]] ^ h[y[0xd]]] ^
-                            gm_09[isbox[c[x[0xe]] ^ k[x[0xe]]] ^ h[y[0xe]]] ^ gm_0e[isbox[c[x[0xf]] ^ k[x[0xf]]] ^ h[y[0xf]]]
-                        ] ^ isbox[
-                            gm_0b[isbox[d[x[0xc]] ^ k[x[0xc]]] ^ h[y[0xc]]] ^ gm_0d[isbox[d[x[0xd]] ^ k[x[0xd]]] ^ h[y[0xd]]] ^
-                            gm_09[isbox[d[x[0xe]] ^ k[x[0xe]]] ^ h[y[0xe]]] ^ gm_0e[isbox[d[x[0xf]] ^ k[x[0xf]]] ^ h[y[0xf]]]
-                        ]
-                    ];
-
-                    if((f0 == f1) && (f1 == f2) && (f2 == f3))
-                    {
-                        candidates.push_back(k);
-                    }
-                }
+                const uint8_t a0 = s[i], a1 = s[i + 0x1], a2 = s[i + 0x2], a3 = s[i + 0x3];
+                s[i] = xtime(a0) ^ xtime(a1) ^ a1 ^ a2 ^ a3;
+                s[i + 0x1] = a0 ^ xtime(a1) ^ xtime(a2) ^ a2 ^ a3;
+                s[i + 0x2] = a0 ^ a1 ^ xtime(a2) ^ xtime(a3) ^ a3;
+                s[i + 0x3] = xtime(a0) ^ a0 ^ a1 ^ a2 ^ xtime(a3);
             }
         }
-    }
-    return candidates;
-}
 
-/* Post-processing of subkey candidates */
-vector<State> postproc(vector<vector<State>> &v)
-{
-    vector<State> r;
-    for(size_t i = 0x0; i < v.size(); ++i)
-    {
-        for(size_t j = 0x0; j < v[i].size(); ++j)
+        /* Next round key */
+        uint8_t w[0x4] = {sbox[k[0xd]], sbox[k[0xe]], sbox[k[0xf]], sbox[k[0xc]]};
+        w[0x0] ^= rcon[j];
+        for(size_t i = 0x0; i < 0x10; ++i)
+        {
+            k[i] ^= (i < 0x4) ? w[i] : k[i - 0x4];
+        }
+        for(size_t i = 0x0; i < 0x10; ++i)
         {
-            r.push_back(reconstruct(v[i][j]));
+            s[i] ^= k[i];
         }
     }
-    return r;
+    return s;
 }
 
-/* Reconstructs the master key from the 10-th round subkey */
+/* Reconstructs the master key from the 10-th round subkey (scalar reference of invert_key_schedule()) */
 State reconstruct(State &k)
 {
     array<uint32_t, 0x2c> sk;
@@ -427,50 +1336,127 @@ vector<pair<pair<State, State>, State>> readfile(const string file, int bf)
     return pairs;
 }
 
-void writefile(State plaintext, State ciphertext, vector<State> keys, const string file)
+/* Two lower-case hex digits of every byte value */
+static const char* hex_table()
 {
-    FILE * outfile;
-    outfile = fopen(file.c_str(), "a");
+    static char t[0x200];
+    static bool done = false;
+#pragma omp critical(hex_table)
+    if(!done)
+    {
+        for(size_t i = 0x0; i < 0x100; ++i)
+        {
+            t[0x2 * i] = "0123456789abcdef"[i >> 0x4];
+            t[0x2 * i + 0x1] = "0123456789abcdef"[i & 0xf];
+        }
+        done = true;
+    }
+    return t;
+}
 
-    if((plaintext.empty() && !ciphertext.empty()) || (!plaintext.empty() && ciphertext.empty()))
+static char* hex(char* p, const uint8_t* x, const size_t n, const char* t)
+{
+    for(size_t i = 0x0; i < n; ++i)
     {
-        printf("ERROR !!!\n");
-        exit(0x1);
+        memcpy(p + 0x2 * i, t + 0x2 * x[i], 0x2);
     }
+    return p + 0x2 * n;
+}
 
-    if(!plaintext.empty())
+static void pwrite_all(const int fd, const char* p, size_t n, off_t offset)
+{
+    while(n > 0x0)
     {
-        for(size_t i = 0x0; i < plaintext.size(); ++i)
-        {
-            fprintf(outfile, "%02x", plaintext[i]);
-        }
-        fprintf(outfile, "\n");
-        for(size_t i = 0x0; i < ciphertext.size(); ++i)
+        ssize_t w = pwrite(fd, p, n, offset);
+        if(w <= 0x0)
         {
-            fprintf(outfile, "%02x", ciphertext[i]);
+            printerror();
         }
-        fprintf(outfile, "\n");
+        p += w;
+        n -= w;
+        offset += w;
     }
-    
-    for(size_t i = 0x0; i < keys.size(); ++i)
+}
+
+/* Writes 'n' lines of fixed 'width' from 'offset' on: each thread formats blocks of lines with line(i, p) into its own buffer
+ * and writes them with one pwrite() at the block's position in the file */
+template<typename F> static void write_lines(const int fd, const off_t offset, const size_t n, const size_t width, F line)
+{
+    const size_t block = min(n, (size_t) 0x10000);
+    if(n == 0x0)
     {
-        for(size_t j = 0x0; j < keys[i].size(); ++j)
+        return;
+    }
+    const size_t blocks = (n + block - 0x1) / block;
+#pragma omp parallel if(blocks > 0x1)
+    {
+        vector<char> buff(block * width);
+#pragma omp for schedule(static)
+        for(size_t b = 0x0; b < blocks; ++b)
         {
-            fprintf(outfile, "%02x", keys[i][j]);
+            const size_t e = min(n, (b + 0x1) * block);
+            for(size_t i = b * block; i < e; ++i)
+            {
+                line(i, &buff[(i - b * block) * width]);
+            }
+            pwrite_all(fd, buff.data(), (e - b * block) * width, offset + b * block * width);
         }
-        fprintf(outfile, "\n");
     }
-    fclose(outfile);
 }
 
-void help()
+/* Appends plaintext and ciphertext, then one key per line, all in hex */
+void writefile(const State &plaintext, const State &ciphertext, const vector<State> &keys, const string file)
+{
+    if((plaintext.empty() && !ciphertext.empty()) || (!plaintext.empty() && ciphertext.empty()))
+    {
+        printf("ERROR !!!\n");
+        exit(0x1);
+    }
+
+    /* Not O_APPEND, pwrite() would ignore the offsets */
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT, 0666);
+    if(fd < 0x0)
+    {
+        printerror();
+    }
+    off_t offset = lseek(fd, 0x0, SEEK_END);
+    const char* t = hex_table();
+
+    if(!plaintext.empty())
+    {
+        char header[0x42];
+        char* p = hex(header, plaintext.data(), 0x10, t);
+        *p++ = '\n';
+        p = hex(p, ciphertext.data(), 0x10, t);
+        *p++ = '\n';
+        pwrite_all(fd, header, sizeof(header), offset);
+        offset += sizeof(header);
+    }
+
+    write_lines(fd, offset, keys.size(), 0x21, [&](const size_t i, char* p)
+    {
+        hex(p, keys[i].data(), 0x10, t)[0x0] = '\n';
+    });
+    close(fd);
+}
+
+/* Sidecar of a key file: each key with the hex mask of the fault locations (bit l for location l) that produced it */
+void writemasks(const vector<Located> &v, const string file)
 {
-    printf("Usage: ./dfa c l b f\n\n" );
-    printf("Parameters\n");
-    printf("%2sc: Number of cores >= 1.\n", "");
-    printf("%2sl: Byte number of the AES state affected by the fault.\n%5sMust be in {-1, 0,..., 15}, where -1 means unknown.\n", "", "");
-    printf("%2sb: Indicate if a brute-force search is needed over remainding master keys.\n%5sMust be 'bf' or 'nobf'.\n", "", "");
-    printf("%2sf: Input file with one or more pairs of correct and faulty ciphertexts; and corresponding plaintext if 'bf'.\n\n","");
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0x0)
+    {
+        printerror();
+    }
+    const char* t = hex_table();
+    write_lines(fd, 0x0, v.size(), 0x26, [&](const size_t i, char* p)
+    {
+        const uint8_t m[0x2] = {(uint8_t) (v[i].mask >> 0x8), (uint8_t) v[i].mask};
+        p = hex(p, v[i].k.data(), 0x10, t);
+        *p++ = ' ';
+        hex(p, m, 0x2, t)[0x0] = '\n';
+    });
+    close(fd);
 }
 
 void printerror()
@@ -479,35 +1465,29 @@ void printerror()
     exit(0x1);
 }
 
+/* Hex digit value, 0 for anything else */
+static uint8_t nibble(const char x)
+{
+    if(x >= '0' && x <= '9')
+    {
+        return x - '0';
+    }
+    if(x >= 'A' && x <= 'F')
+    {
+        return x - 'A' + 0xa;
+    }
+    if(x >= 'a' && x <= 'f')
+    {
+        return x - 'a' + 0xa;
+    }
+    return 0x0;
+}
+
 void convert(char* buff, uint8_t* data)
 {
     for(size_t i = 0x0; i < 0x10; ++i)
     {
-        if(buff[0x2 * i] >= 0x30 && buff[0x2 * i] <= 0x39)
-        {
-            data[i] = buff[0x2 * i] - 0x30;
-        }
-        if(buff[0x2 * i] >= 0x41 && buff[0x2 * i] <= 0x5a)
-        {
-            data[i] = buff[0x2 * i] - 0x41 + 0xa;
-        }
-        if(buff[0x2 * i] >= 0x61 && buff[0x2 * i] <= 0x7a)
-        {
-            data[i] = buff[0x2 * i] - 0x61 + 10;
-        }
-        
-        if(buff[0x2 * i + 0x1] >= 0x30 && buff[0x2 * i + 0x1] <= 0x39)
-        {
-            data[i] |= (buff[0x2 * i + 0x1] - 0x30) << 0x4;
-        }
-        if(buff[0x2 * i + 0x1] >= 0x41 && buff[0x2 * i + 0x1] <= 0x5a)
-        {
-            data[i] |= (buff[0x2 * i + 0x1] - 0x41 + 0xa) << 0x4;
-        }
-        if(buff[0x2 * i + 0x1] >= 0x61 && buff[0x2 * i + 0x1] <= 0x7a)
-        {
-            data[i] |= (buff[0x2 * i + 0x1] - 0x61 + 10) << 0x4;
-        }
+        data[i] = (nibble(buff[0x2 * i]) << 0x4) | nibble(buff[0x2 * i + 0x1]);
     }
 }
 
@@ -516,9 +1496,6 @@ void bruteforce(const string name)
     char buff[0x21];
     uint8_t plaintext[0x10];
     uint8_t expected[0x10];
-    uint8_t key[0x10];
-    uint8_t* ciphertext;
-    printf("PLOP\n");
     FILE* file = fopen(name.c_str(), "r");
     if(file == NULL)
     {
@@ -539,99 +1516,27 @@ void bruteforce(const string name)
     }
     convert(buff, expected);
     
-    /* TESTING EACH KEY */
-    while(fread(buff, 0x21, 0x1, file) == 0x1)
+    /* TESTING THE KEYS IN BATCHES */
+    const size_t batch = 0x1000;
+    vector<uint8_t> keys(0x10 * batch);
+    bool more = true;
+    while(more)
     {
-        convert(buff, key);
-        ciphertext = encrypt(key, plaintext);
-        if(!memcmp(ciphertext, expected, (size_t) sizeof(expected)))
+        size_t n = 0x0;
+        while(n < batch && (more = (fread(buff, 0x21, 0x1, file) == 0x1)))
+        {
+            convert(buff, &keys[0x10 * n++]);
+        }
+        size_t i = engine().verify(keys.data(), n, plaintext, expected);
+        if(i < n)
         {
             printf("THE ONE KEY FOUND !!!\n");
-            for(size_t i = 0x0; i < (size_t) sizeof(key); ++i)
+            for(size_t j = 0x0; j < 0x10; ++j)
             {
-                printf("%02x", key[i]);
+                printf("%02x", keys[0x10 * i + j]);
             }
             exit(0x0);
         }
     }
-}
-
-int main(int argc, char **argv)
-{
-    if(argc != 0x5)
-    {
-        help();
-        return -0x1;
-    }
-
-    const size_t c = atoi(argv[0x1]);   // number of cores
-    const int l = atoi(argv[0x2]);      // fault location
-    const char* b = argv[0x3];          // brute-force
-    const string f = argv[0x4];         // input file
-
-    if(c < 0x0 || l < -0x1 || l > 0xf || (strcmp(b, "bf") && strcmp(b, "nobf")) || f.empty())
-    {
-        help();
-        return -0x1;
-    }
-
-    vector<pair<pair<State, State>, State>> pairs = readfile(f, !strcmp(b, "bf"));
-
-    /* Set fault location range */
-    size_t j = 0x0;
-    size_t n = 0x0;
-    if(l == -0x1)
-    {
-        n = 16;
-    } else {
-        j = l;
-        n = l + 0x1;
-    }
-
-    for(size_t i = 0x0; i < pairs.size(); ++i)
-    {
-        printf("(%lu) Analysing ciphertext pair:\n\n", i);
-        printState(pairs[i].first.first);
-        printf(" ");
-        printState(pairs[i].first.second);
-        printf("\n\nNumber of core(s): %lu \n", c);
-
-        /* Create new output file */
-        stringstream ss;
-        ss << "res/" << i << ".csv";
-        FILE * outfile;
-        const string name = ss.str();
-        outfile = fopen(name.c_str(), "w");
-        fclose(outfile);
-
-        size_t count = 0x0;
-        while(j < n){
-            printf("----------------------------------------------------\n");
-            printf("Fault location: %lu\n", j);
-            vector<State> keys = analyse(pairs[i].first.first, pairs[i].first.second, j, c);
-            count += keys.size();
-            State plaintext, expected;
-            if(strcmp(b, "bf"))
-            {
-                plaintext = pairs[i].second;
-                expected = pairs[i].first.first;
-            }
-            writefile(plaintext, expected, keys, name);
-            j++;
-        }
-        if(l == -0x1)   // Reset j
-        {
-            j = 0x0;
-        }
-        else
-        {
-            j = l;
-        }
-        if(!strcmp(b, "bf"))
-        {
-            bruteforce(name);
-        }
-        printf("\n\n%lu masterkeys written to %s\n\n", count, name.c_str());
-    }
-    return 0x0;
+    fclose(file);
 }
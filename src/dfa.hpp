@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "constant.hpp"
+#include "kernel.hpp"
 
 using namespace std;
 
@@ -38,6 +39,32 @@ using DiffStat = array<multimap<uint8_t,uint8_t>, 0x10>;
 /* Data structure for vector of key candidate tuples */
 using VKeyTuple = vector<KeyTuple>;
 
+/* Standard filter outcome of a pair: number of column candidates for each location class (see map_fault) and column */
+struct Triage
+{
+    uint64_t n[0x4][0x4];
+    bool valid;
+};
+
+/* Predicted cost of the improved filter for one pair and location, from a sample run of the kernel */
+struct Estimate
+{
+    double keyspace;
+    double sampled;
+    double rate;        // candidates per second on all cores
+    double seconds;
+    double survivors;   // extrapolated from the sample
+    double expected;    // keyspace / 2^24
+    double memory;      // bytes
+};
+
+/* Master key with a bitmask of the fault locations that produced it */
+struct Located
+{
+    State k;
+    uint16_t mask;
+};
+
 /* Galois multiplication tables */
 static map<uint8_t, const uint8_t*> gmt =
 {
@@ -63,7 +90,7 @@ static const uint8_t rb[0x4][0x4] =
 static const size_t map_fault[0x10] = {0x0, 0x1, 0x2, 0x3, 0x3, 0x0, 0x1, 0x2, 0x2, 0x3, 0x0, 0x1, 0x1, 0x2, 0x3, 0x0};
 
 /* Pointer to inverses of fault deltas in GF(256) for the standard filter (depend on the fault location) */
-static const uint8_t* ideltas1[0x4][0x10] = 
+static const uint8_t* const ideltas1[0x4][0x10] = 
 {
     {gm_8d, gm_01, gm_8d, gm_01, gm_01, gm_f6, gm_01, gm_f6, gm_01, gm_8d, gm_01, gm_8d, gm_f6, gm_01, gm_f6, gm_01},
     {gm_01, gm_f6, gm_01, gm_f6, gm_01, gm_8d, gm_01, gm_8d, gm_f6, gm_01, gm_f6, gm_01, gm_8d, gm_01, gm_8d, gm_01},
@@ -72,7 +99,7 @@ static const uint8_t* ideltas1[0x4][0x10] =
 };
 
 /* Pointer to inverses of fault deltas in GF(256) for the improved filter (depend on the fault location) */
-static const uint8_t* ideltas2[0x4][0x4] =
+static const uint8_t* const ideltas2[0x4][0x4] =
 {
     {gm_8d, gm_01, gm_01, gm_f6},
     {gm_f6, gm_8d, gm_01, gm_01},
@@ -80,6 +107,15 @@ static const uint8_t* ideltas2[0x4][0x4] =
     {gm_01, gm_01, gm_f6, gm_8d}
 };
 
+/* Identifiers of the tables in ideltas2, to look up their node-local copies */
+static const GmTable ideltas2_id[0x4][0x4] =
+{
+    {GM_8D, GM_01, GM_01, GM_F6},
+    {GM_F6, GM_8D, GM_01, GM_01},
+    {GM_01, GM_F6, GM_8D, GM_01},
+    {GM_01, GM_01, GM_F6, GM_8D}
+};
+
 /* indices for c,d and the 0xa-th round key k (improved fault equations) */
 static const size_t indices_x[0x4][0x10] =
 {
@@ -98,20 +134,61 @@ static const size_t indices_y[0x4][16] =
     {0x4, 0x5, 0x6, 0x7, 0x0, 0x1, 0x2, 0x3, 0xc, 0xd, 0xe, 0xf, 0x8, 0x9, 0xa, 0xb}
 };
 
+/* Progress messages of the analysis on stdout, off in the Python module */
+extern bool verbose;
+
+void progress(const char* format, ...);
+
 vector<State> analyse(State &c, State &d, const size_t l, const size_t cores);
 
+vector<State> analyse_joint(vector<pair<State, State>> &pairs, const size_t j, const size_t n, const size_t cores);
+
+vector<VKeyTuple> candidates(State &c, State &d, const size_t j, const size_t n, vector<vector<VKeyTuple>> &cand);
+
+vector<VKeyTuple> intersect(const vector<VKeyTuple> &a, const vector<VKeyTuple> &b);
+
+bool explains(const State &c, const State &d, const vector<vector<VKeyTuple>> &cand, const State &k, const State &h, const size_t j);
+
+vector<State> joint_filter(vector<pair<State, State>> &pairs, vector<vector<vector<VKeyTuple>>> &cand, vector<VKeyTuple> &cmb, const size_t j, const size_t cores);
+
+vector<State> analyse_round9(vector<pair<State, State>> &pairs, const size_t j, const size_t n, const size_t cores);
+
+VKeyTuple column9(State &c, State &d, const size_t i, const size_t r);
+
 DiffStat differentials(State &c, State &d, const size_t l);
 
 DiffStat standard_filter(DiffStat x);
 
 vector<VKeyTuple> combine(DiffStat x);
 
-vector<vector<VKeyTuple>> preproc(vector<VKeyTuple> cmb, const size_t cores);
+vector<VKeyTuple> columns(State &c, State &d, const size_t l);
+
+Triage triage(const State &c, const State &d);
+
+size_t triage_corpus(const vector<pair<pair<State, State>, State>> &pairs, const size_t j, const size_t n, const size_t cores, const string file);
+
+vector<State> search(State &c, State &d, vector<VKeyTuple> &cmb, const size_t l, const size_t cores, vector<double>* busy = NULL);
+
+Estimate estimate(State &c, State &d, const size_t l, const size_t cores, const size_t samples);
+
+size_t verify_engine(const Engine &e, State &c, State &d, const size_t l, const size_t samples, const size_t cores);
 
 vector<State> improved_filter(State &c, State &d, vector<VKeyTuple> &v, const size_t l);
 
+State join(const KeyTuple* const t[0x4]);
+
+State round9(const State &k);
+
+bool improved_eq(const State &c, const State &d, const State &k, const State &h, const size_t l);
+
 vector<State> postproc(vector<vector<State>> &v);
 
+void sort_keys(vector<Located> &v, const size_t cores);
+
+vector<Located> intersect_keys(const vector<Located> &a, const vector<Located> &b);
+
+State encrypt_fault(const State &key, const State &p, const size_t r, const size_t l, const uint8_t f);
+
 State reconstruct(State &k);
 
 uint32_t ks_core(uint32_t t, size_t r);
@@ -122,9 +199,17 @@ void printState(State x);
 
 vector<pair<pair<State, State>, State>> readfile(const string file, int bf);
 
-void writefile(State plaintext, State ciphertext, vector<State> keys, const string file);
+void writefile(const State &plaintext, const State &ciphertext, const vector<State> &keys, const string file);
+
+void writemasks(const vector<Located> &v, const string file);
+
+void printerror();
+
+void convert(char* buff, uint8_t* data);
+
+void bruteforce(const string name);
 
-static uint8_t EQ(const uint8_t c, const uint8_t d, const uint8_t k, const uint8_t* gm)
+static inline uint8_t EQ(const uint8_t c, const uint8_t d, const uint8_t k, const uint8_t* gm)
 {
     return gm[isbox[c ^ k] ^ isbox[d ^ k]];
 }
@@ -0,0 +1,109 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.hpp"
+
+static bool sse_supported()
+{
+    return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("aes");
+}
+
+static bool avx2_supported()
+{
+    return sse_supported() && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+}
+
+static bool avx512_supported()
+{
+    return avx2_supported() && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+           __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("gfni") && __builtin_cpu_supports("vaes");
+}
+
+/* Best first, the scalar reference is only used when asked for */
+static const Engine engines[] =
+{
+    {"avx512", avx512_supported, improved_kernel_avx512, deltas_avx512, verify_keys_avx512, invert_key_schedule_avx512, false},
+    {"avx2", avx2_supported, improved_kernel_avx2, deltas_avx2, verify_keys_avx2, invert_key_schedule_avx2, false},
+    {"sse", sse_supported, improved_kernel_sse, deltas_sse, verify_keys_sse, invert_key_schedule_sse, false},
+    {"reference", sse_supported, reference_kernel, reference_deltas, reference_verify, reference_invert, true}
+};
+
+static const size_t n_engines = sizeof(engines) / sizeof(engines[0x0]);
+
+/* Set by select_engine(), possibly while workers of another analysis call engine() */
+static std::atomic<const Engine*> selected(NULL);
+
+/* Best engine the CPU supports */
+static const Engine* best()
+{
+    for(size_t i = 0x0; i < n_engines; ++i)
+    {
+        if(!engines[i].reference && engines[i].supported())
+        {
+            return &engines[i];
+        }
+    }
+    printf("ERROR: CPU without AES-NI !!!\n");
+    exit(0x1);
+}
+
+/* Engine in use, the best one the CPU supports unless select_engine() chose another. The first call may come from inside
+ * a parallel region, the function-local static is initialised exactly once. */
+const Engine &engine()
+{
+    static const Engine* const b = best();
+    const Engine* e = selected.load();
+    return (e != NULL) ? *e : *b;
+}
+
+/* Scalar reference, to check the other engines against */
+const Engine &reference_engine()
+{
+    for(size_t i = 0x0; i < n_engines; ++i)
+    {
+        if(engines[i].reference)
+        {
+            return engines[i];
+        }
+    }
+    printf("ERROR: no reference engine !!!\n");
+    exit(0x1);
+}
+
+/* Engine 'name' if known and supported by this CPU, NULL otherwise */
+const Engine* find_engine(const char* name)
+{
+    for(size_t i = 0x0; i < n_engines; ++i)
+    {
+        if(!strcmp(engines[i].name, name) && engines[i].supported())
+        {
+            return &engines[i];
+        }
+    }
+    return NULL;
+}
+
+/* Forces the engine 'name', false if it is unknown or not supported by this CPU */
+bool select_engine(const char* name)
+{
+    const Engine* e = find_engine(name);
+    if(e != NULL)
+    {
+        selected = e;
+    }
+    return e != NULL;
+}
+
+void print_engines()
+{
+    for(size_t i = 0x0; i < n_engines; ++i)
+    {
+        printf("%s%s%s\n", engines[i].name, engines[i].supported() ? "" : " (not supported)", &engines[i] == &engine() ? " *" : "");
+    }
+}
@@ -0,0 +1,449 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <cstdint>
+#include <immintrin.h>
+
+#include "constant.hpp"
+#include "kernel.hpp"
+
+#if defined(__AVX512BW__) && defined(__GFNI__)
+
+/* GF(256) arithmetic of 64 bytes at once: SBox and inverse SBox as (inverse) affine maps, gm_* tables as multiplications */
+static inline __m512i sbox512(const __m512i x)
+{
+    return _mm512_gf2p8affineinv_epi64_epi8(x, _mm512_set1_epi64(0xf1e3c78f1f3e7cf8), 0x63);
+}
+
+static inline __m512i isbox512(const __m512i x)
+{
+    __m512i y = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64(0xa44992254a942952), 0x05);
+    return _mm512_gf2p8affineinv_epi64_epi8(y, _mm512_set1_epi64(0x0102040810204080), 0x0);
+}
+
+static inline __m512i mul512(const __m512i x, const uint8_t g)
+{
+    return _mm512_gf2p8mul_epi8(x, _mm512_set1_epi8(g));
+}
+
+/* Improved filter over the column-0 tuples [b, e), 64 tuples of column 3 per vector */
+void improved_kernel(const NodeData &x, const size_t b, const size_t e, Arena* a)
+{
+    static const uint8_t im[0x4][0x4] =
+    {
+        {0x0e, 0x0b, 0x0d, 0x09},
+        {0x09, 0x0e, 0x0b, 0x0d},
+        {0x0d, 0x09, 0x0e, 0x0b},
+        {0x0b, 0x0d, 0x09, 0x0e}
+    };
+
+    uint8_t k[0x10], uc[0x10], ud[0x10];
+    size_t idx[0x4];
+    for(idx[0x0] = b; idx[0x0] < e; ++idx[0x0])
+    {
+        for(idx[0x1] = 0x0; idx[0x1] < x.n[0x1]; ++idx[0x1])
+        {
+            for(idx[0x2] = 0x0; idx[0x2] < x.n[0x2]; ++idx[0x2])
+            {
+                /* Key bytes of columns 0-2 are the same in all lanes, column 3 varies per lane */
+                __m512i K[0x10], C[0x10], D[0x10];
+                for(size_t i = 0x0; i < 0x10; ++i)
+                {
+                    const size_t j = x.col[i];
+                    if(j < 0x3)
+                    {
+                        k[i] = x.v[j][0x4 * idx[j] + x.pos[i]];
+                        uc[i] = x.ic[j][0x4 * idx[j] + x.pos[i]];
+                        ud[i] = x.id[j][0x4 * idx[j] + x.pos[i]];
+                    }
+                }
+
+                for(size_t i3 = 0x0; i3 < x.n[0x3]; i3 += 0x40)
+                {
+                    for(size_t i = 0x0; i < 0x10; ++i)
+                    {
+                        if(x.col[i] == 0x3)
+                        {
+                            K[i] = _mm512_loadu_si512(x.t3[0x0][x.pos[i]] + i3);
+                            C[i] = _mm512_loadu_si512(x.t3[0x1][x.pos[i]] + i3);
+                            D[i] = _mm512_loadu_si512(x.t3[0x2][x.pos[i]] + i3);
+                        }
+                        else
+                        {
+                            K[i] = _mm512_set1_epi8(k[i]);
+                            C[i] = _mm512_set1_epi8(uc[i]);
+                            D[i] = _mm512_set1_epi8(ud[i]);
+                        }
+                    }
+
+                    /* 9-th round key */
+                    __m512i H[0x10];
+                    H[0x0] = _mm512_xor_si512(_mm512_xor_si512(K[0x0], sbox512(_mm512_xor_si512(K[0x9], K[0xd]))), _mm512_set1_epi8(0x36));
+                    H[0x1] = _mm512_xor_si512(K[0x1], sbox512(_mm512_xor_si512(K[0xa], K[0xe])));
+                    H[0x2] = _mm512_xor_si512(K[0x2], sbox512(_mm512_xor_si512(K[0xb], K[0xf])));
+                    H[0x3] = _mm512_xor_si512(K[0x3], sbox512(_mm512_xor_si512(K[0x8], K[0xc])));
+                    for(size_t i = 0x4; i < 0x10; ++i)
+                    {
+                        H[i] = _mm512_xor_si512(K[i - 0x4], K[i]);
+                    }
+
+                    /* Fault values of the four equations */
+                    __m512i F[0x4];
+                    for(size_t i = 0x0; i < 0x4; ++i)
+                    {
+                        __m512i u = _mm512_setzero_si512();
+                        __m512i w = _mm512_setzero_si512();
+                        for(size_t j = 0x0; j < 0x4; ++j)
+                        {
+                            const size_t s = 0x4 * i + j;
+                            u = _mm512_xor_si512(u, mul512(_mm512_xor_si512(C[x.x[s]], H[x.y[s]]), im[i][j]));
+                            w = _mm512_xor_si512(w, mul512(_mm512_xor_si512(D[x.x[s]], H[x.y[s]]), im[i][j]));
+                        }
+                        F[i] = mul512(_mm512_xor_si512(isbox512(u), isbox512(w)), x.g[i]);
+                    }
+
+                    __mmask64 m = (x.n[0x3] - i3 >= 0x40) ? ~(__mmask64) 0x0 : (((__mmask64) 0x1 << (x.n[0x3] - i3)) - 0x1);
+                    m &= _mm512_cmpeq_epi8_mask(F[0x0], F[0x1]) & _mm512_cmpeq_epi8_mask(F[0x0], F[0x2]) & _mm512_cmpeq_epi8_mask(F[0x0], F[0x3]);
+                    while(m)
+                    {
+                        const size_t i = i3 + __builtin_ctzll(m);
+                        m &= m - 0x1;
+                        for(size_t j = 0x0; j < 0x10; ++j)
+                        {
+                            if(x.col[j] == 0x3)
+                            {
+                                k[j] = x.v[0x3][0x4 * i + x.pos[j]];
+                            }
+                        }
+                        arena_push(a, k);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Fault deltas of all 256 key guesses for each byte, 64 guesses per vector */
+void deltas(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r)
+{
+    const __m512i iota = _mm512_set_epi8(0x3f, 0x3e, 0x3d, 0x3c, 0x3b, 0x3a, 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33, 0x32, 0x31, 0x30,
+                                         0x2f, 0x2e, 0x2d, 0x2c, 0x2b, 0x2a, 0x29, 0x28, 0x27, 0x26, 0x25, 0x24, 0x23, 0x22, 0x21, 0x20,
+                                         0x1f, 0x1e, 0x1d, 0x1c, 0x1b, 0x1a, 0x19, 0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11, 0x10,
+                                         0x0f, 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00);
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        for(size_t k = 0x0; k < 0x100; k += 0x40)
+        {
+            __m512i key = _mm512_or_si512(iota, _mm512_set1_epi8(k));
+            __m512i u = isbox512(_mm512_xor_si512(key, _mm512_set1_epi8(c[i])));
+            __m512i w = isbox512(_mm512_xor_si512(key, _mm512_set1_epi8(d[i])));
+            _mm512_storeu_si512(r + 0x100 * i + k, mul512(_mm512_xor_si512(u, w), gm[i][0x1]));
+        }
+    }
+}
+
+#elif defined(__AVX2__)
+
+/* 256-entry byte table as 16 rows of 16 bytes, in both lanes for vpshufb */
+struct Table256
+{
+    __m256i row[0x10];
+};
+
+/* Multiplication by a GF(256) constant, which is linear: one 16-byte table for each nibble */
+struct Mul256
+{
+    __m256i lo;
+    __m256i hi;
+};
+
+static inline __m256i broadcast16(const uint8_t* p)
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) p));
+}
+
+static void table256(Table256 &t, const uint8_t* s)
+{
+    for(size_t h = 0x0; h < 0x10; ++h)
+    {
+        t.row[h] = broadcast16(s + 0x10 * h);
+    }
+}
+
+static void mul256(Mul256 &m, const uint8_t* gm)
+{
+    uint8_t lo[0x10], hi[0x10];
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        lo[i] = gm[i];
+        hi[i] = gm[i << 0x4];
+    }
+    m.lo = broadcast16(lo);
+    m.hi = broadcast16(hi);
+}
+
+/* t[x] of 32 bytes: row h is only looked up by the bytes with high nibble h, the others get an index with bit 7 set
+ * (vpshufb yields 0 for those) from (x - 16 h) + 0x70 with unsigned saturation */
+static inline __m256i lookup256(const Table256 &t, const __m256i x)
+{
+    const __m256i step = _mm256_set1_epi8(0x10);
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    __m256i r = _mm256_shuffle_epi8(t.row[0x0], _mm256_adds_epu8(x, bias));
+    __m256i z = x;
+    for(size_t h = 0x1; h < 0x10; ++h)
+    {
+        z = _mm256_sub_epi8(z, step);
+        r = _mm256_xor_si256(r, _mm256_shuffle_epi8(t.row[h], _mm256_adds_epu8(z, bias)));
+    }
+    return r;
+}
+
+static inline __m256i apply256(const Mul256 &m, const __m256i x)
+{
+    const __m256i f = _mm256_set1_epi8(0x0f);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(m.lo, _mm256_and_si256(x, f)),
+                            _mm256_shuffle_epi8(m.hi, _mm256_and_si256(_mm256_srli_epi16(x, 0x4), f)));
+}
+
+/* Fault value of row 'i' for 32 candidates, see improved_filter() */
+static inline __m256i equation256(const NodeData &x, const Table256 &is, const Mul256 im[0x4][0x4], const Mul256 g[0x4],
+                                  const __m256i* C, const __m256i* D, const __m256i* H, const size_t i)
+{
+    __m256i u = _mm256_setzero_si256();
+    __m256i w = _mm256_setzero_si256();
+    for(size_t j = 0x0; j < 0x4; ++j)
+    {
+        const size_t s = 0x4 * i + j;
+        u = _mm256_xor_si256(u, apply256(im[i][j], _mm256_xor_si256(C[x.x[s]], H[x.y[s]])));
+        w = _mm256_xor_si256(w, apply256(im[i][j], _mm256_xor_si256(D[x.x[s]], H[x.y[s]])));
+    }
+    return apply256(g[i], _mm256_xor_si256(lookup256(is, u), lookup256(is, w)));
+}
+
+/* Improved filter over the column-0 tuples [b, e), 32 tuples of column 3 per vector; rows 2 and 3 of the fault equations
+ * only for the vectors where a lane passes rows 0 and 1 */
+void improved_kernel(const NodeData &x, const size_t b, const size_t e, Arena* a)
+{
+    const Tables &t = x.t;
+    const uint8_t* const tm[0x4][0x4] =
+    {
+        {t.gm_0e, t.gm_0b, t.gm_0d, t.gm_09},
+        {t.gm_09, t.gm_0e, t.gm_0b, t.gm_0d},
+        {t.gm_0d, t.gm_09, t.gm_0e, t.gm_0b},
+        {t.gm_0b, t.gm_0d, t.gm_09, t.gm_0e}
+    };
+    Table256 sb, is;
+    Mul256 im[0x4][0x4], g[0x4];
+    table256(sb, t.sbox);
+    table256(is, t.isbox);
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        mul256(g[i], x.gm[i]);
+        for(size_t j = 0x0; j < 0x4; ++j)
+        {
+            mul256(im[i][j], tm[i][j]);
+        }
+    }
+
+    uint8_t k[0x10], uc[0x10], ud[0x10];
+    size_t idx[0x4];
+    for(idx[0x0] = b; idx[0x0] < e; ++idx[0x0])
+    {
+        for(idx[0x1] = 0x0; idx[0x1] < x.n[0x1]; ++idx[0x1])
+        {
+            for(idx[0x2] = 0x0; idx[0x2] < x.n[0x2]; ++idx[0x2])
+            {
+                /* Key bytes of columns 0-2 are the same in all lanes, column 3 varies per lane */
+                __m256i K[0x10], C[0x10], D[0x10];
+                for(size_t i = 0x0; i < 0x10; ++i)
+                {
+                    const size_t j = x.col[i];
+                    if(j < 0x3)
+                    {
+                        k[i] = x.v[j][0x4 * idx[j] + x.pos[i]];
+                        uc[i] = x.ic[j][0x4 * idx[j] + x.pos[i]];
+                        ud[i] = x.id[j][0x4 * idx[j] + x.pos[i]];
+                    }
+                }
+
+                for(size_t i3 = 0x0; i3 < x.n[0x3]; i3 += 0x20)
+                {
+                    for(size_t i = 0x0; i < 0x10; ++i)
+                    {
+                        if(x.col[i] == 0x3)
+                        {
+                            K[i] = _mm256_loadu_si256((const __m256i*) (x.t3[0x0][x.pos[i]] + i3));
+                            C[i] = _mm256_loadu_si256((const __m256i*) (x.t3[0x1][x.pos[i]] + i3));
+                            D[i] = _mm256_loadu_si256((const __m256i*) (x.t3[0x2][x.pos[i]] + i3));
+                        }
+                        else
+                        {
+                            K[i] = _mm256_set1_epi8(k[i]);
+                            C[i] = _mm256_set1_epi8(uc[i]);
+                            D[i] = _mm256_set1_epi8(ud[i]);
+                        }
+                    }
+
+                    /* 9-th round key */
+                    __m256i H[0x10];
+                    H[0x0] = _mm256_xor_si256(_mm256_xor_si256(K[0x0], lookup256(sb, _mm256_xor_si256(K[0x9], K[0xd]))), _mm256_set1_epi8(0x36));
+                    H[0x1] = _mm256_xor_si256(K[0x1], lookup256(sb, _mm256_xor_si256(K[0xa], K[0xe])));
+                    H[0x2] = _mm256_xor_si256(K[0x2], lookup256(sb, _mm256_xor_si256(K[0xb], K[0xf])));
+                    H[0x3] = _mm256_xor_si256(K[0x3], lookup256(sb, _mm256_xor_si256(K[0x8], K[0xc])));
+                    for(size_t i = 0x4; i < 0x10; ++i)
+                    {
+                        H[i] = _mm256_xor_si256(K[i - 0x4], K[i]);
+                    }
+
+                    const uint32_t tail = (x.n[0x3] - i3 >= 0x20) ? ~(uint32_t) 0x0 : (((uint32_t) 0x1 << (x.n[0x3] - i3)) - 0x1);
+                    const __m256i f0 = equation256(x, is, im, g, C, D, H, 0x0);
+                    uint32_t m = tail & (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(f0, equation256(x, is, im, g, C, D, H, 0x1)));
+                    if(!m)
+                    {
+                        continue;
+                    }
+                    m &= (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(f0, equation256(x, is, im, g, C, D, H, 0x2)));
+                    m &= (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(f0, equation256(x, is, im, g, C, D, H, 0x3)));
+                    while(m)
+                    {
+                        const size_t i = i3 + __builtin_ctz(m);
+                        m &= m - 0x1;
+                        for(size_t j = 0x0; j < 0x10; ++j)
+                        {
+                            if(x.col[j] == 0x3)
+                            {
+                                k[j] = x.v[0x3][0x4 * i + x.pos[j]];
+                            }
+                        }
+                        arena_push(a, k);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Fault deltas of all 256 key guesses for each byte, 32 guesses per vector */
+void deltas(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r)
+{
+    const __m256i iota = _mm256_set_epi8(0x1f, 0x1e, 0x1d, 0x1c, 0x1b, 0x1a, 0x19, 0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11, 0x10,
+                                         0x0f, 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00);
+    Table256 is;
+    table256(is, isbox);
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        Mul256 g;
+        mul256(g, gm[i]);
+        for(size_t k = 0x0; k < 0x100; k += 0x20)
+        {
+            __m256i key = _mm256_or_si256(iota, _mm256_set1_epi8(k));
+            __m256i u = lookup256(is, _mm256_xor_si256(key, _mm256_set1_epi8(c[i])));
+            __m256i w = lookup256(is, _mm256_xor_si256(key, _mm256_set1_epi8(d[i])));
+            _mm256_storeu_si256((__m256i*) (r + 0x100 * i + k), apply256(g, _mm256_xor_si256(u, w)));
+        }
+    }
+}
+
+#else
+
+/* One fault equation (row 'i') of improved_filter() on precomputed isbox[c ^ k] and isbox[d ^ k] */
+static inline uint8_t equation(const NodeData &x, const uint8_t* const im[0x4][0x4], const size_t* qc, const size_t* qm,
+                               const uint8_t* const pc[0x4], const uint8_t* const pd[0x4], const uint8_t* h, const size_t i)
+{
+    uint8_t u = 0x0;
+    uint8_t w = 0x0;
+    for(size_t j = 0x0; j < 0x4; ++j)
+    {
+        const size_t s = 0x4 * i + j;
+        u ^= im[i][j][pc[qc[s]][qm[s]] ^ h[x.y[s]]];
+        w ^= im[i][j][pd[qc[s]][qm[s]] ^ h[x.y[s]]];
+    }
+    return x.gm[i][x.t.isbox[u] ^ x.t.isbox[w]];
+}
+
+/* Improved filter over the column-0 tuples [b, e) of the node-local candidate space 'x', survivors go to the arena 'a' */
+void improved_kernel(const NodeData &x, const size_t b, const size_t e, Arena* a)
+{
+    const Tables &t = x.t;
+    const uint8_t* const im[0x4][0x4] =
+    {
+        {t.gm_0e, t.gm_0b, t.gm_0d, t.gm_09},
+        {t.gm_09, t.gm_0e, t.gm_0b, t.gm_0d},
+        {t.gm_0d, t.gm_09, t.gm_0e, t.gm_0b},
+        {t.gm_0b, t.gm_0d, t.gm_09, t.gm_0e}
+    };
+
+    /* Column and position within its tuple of the key byte used by each term */
+    size_t qc[0x10], qm[0x10];
+    for(size_t s = 0x0; s < 0x10; ++s)
+    {
+        qc[s] = x.col[x.x[s]];
+        qm[s] = x.pos[x.x[s]];
+    }
+
+    uint8_t k[0x10];
+    uint8_t h[0x10];
+    const uint8_t* pc[0x4];
+    const uint8_t* pd[0x4];
+    for(size_t i0 = b; i0 < e; ++i0)
+    {
+        pc[0x0] = x.ic[0x0] + 0x4 * i0;
+        pd[0x0] = x.id[0x0] + 0x4 * i0;
+        k[0x0] = x.v[0x0][0x4 * i0]; k[0x7] = x.v[0x0][0x4 * i0 + 0x1]; k[0xa] = x.v[0x0][0x4 * i0 + 0x2]; k[0xd] = x.v[0x0][0x4 * i0 + 0x3];
+
+        for(size_t i1 = 0x0; i1 < x.n[0x1]; ++i1)
+        {
+            pc[0x1] = x.ic[0x1] + 0x4 * i1;
+            pd[0x1] = x.id[0x1] + 0x4 * i1;
+            k[0x1] = x.v[0x1][0x4 * i1]; k[0x4] = x.v[0x1][0x4 * i1 + 0x1]; k[0xb] = x.v[0x1][0x4 * i1 + 0x2]; k[0xe] = x.v[0x1][0x4 * i1 + 0x3];
+
+            for(size_t i2 = 0x0; i2 < x.n[0x2]; ++i2)
+            {
+                pc[0x2] = x.ic[0x2] + 0x4 * i2;
+                pd[0x2] = x.id[0x2] + 0x4 * i2;
+                k[0x2] = x.v[0x2][0x4 * i2]; k[0x5] = x.v[0x2][0x4 * i2 + 0x1]; k[0x8] = x.v[0x2][0x4 * i2 + 0x2]; k[0xf] = x.v[0x2][0x4 * i2 + 0x3];
+
+                for(size_t i3 = 0x0; i3 < x.n[0x3]; ++i3)
+                {
+                    pc[0x3] = x.ic[0x3] + 0x4 * i3;
+                    pd[0x3] = x.id[0x3] + 0x4 * i3;
+                    k[0x3] = x.v[0x3][0x4 * i3]; k[0x6] = x.v[0x3][0x4 * i3 + 0x1]; k[0x9] = x.v[0x3][0x4 * i3 + 0x2]; k[0xc] = x.v[0x3][0x4 * i3 + 0x3];
+
+                    /* 9-th round key */
+                    h[0x0] = k[0x0] ^ t.sbox[k[0x9] ^ k[0xd]] ^ 0x36;
+                    h[0x1] = k[0x1] ^ t.sbox[k[0xa] ^ k[0xe]];
+                    h[0x2] = k[0x2] ^ t.sbox[k[0xb] ^ k[0xf]];
+                    h[0x3] = k[0x3] ^ t.sbox[k[0x8] ^ k[0xc]];
+                    for(size_t i = 0x4; i < 0x10; ++i)
+                    {
+                        h[i] = k[i - 0x4] ^ k[i];
+                    }
+
+                    /* Stop at the first unequal fault value, which is the common case */
+                    uint8_t f0 = equation(x, im, qc, qm, pc, pd, h, 0x0);
+                    if(f0 != equation(x, im, qc, qm, pc, pd, h, 0x1) || f0 != equation(x, im, qc, qm, pc, pd, h, 0x2) ||
+                       f0 != equation(x, im, qc, qm, pc, pd, h, 0x3))
+                    {
+                        continue;
+                    }
+                    arena_push(a, k);
+                }
+            }
+        }
+    }
+}
+
+/* Fault deltas EQ() of all 256 key guesses for each byte */
+void deltas(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r)
+{
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        for(size_t k = 0x0; k < 0x100; ++k)
+        {
+            r[0x100 * i + k] = gm[i][isbox[c[i] ^ k] ^ isbox[d[i] ^ k]];
+        }
+    }
+}
+
+#endif
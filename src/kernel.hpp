@@ -0,0 +1,120 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+/* The hot kernels (kernel.cpp, aes.c) are compiled once per instruction set with KERNEL_ISA set to its name. They only
+ * see this header, so no inline STL code is built with instructions the baseline binary must not use. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Arena;
+
+/* Appends a surviving 10-th round key to an arena, see numa.cpp */
+void arena_push(Arena* a, const uint8_t* k);
+
+/* Identifiers of the gm_* tables */
+enum GmTable { GM_01, GM_09, GM_0B, GM_0D, GM_0E, GM_8D, GM_F6 };
+
+/* Lookup tables of the improved filter, copied once per NUMA node */
+struct Tables
+{
+    uint8_t sbox[0x100];
+    uint8_t isbox[0x100];
+    uint8_t gm_01[0x100];
+    uint8_t gm_09[0x100];
+    uint8_t gm_0b[0x100];
+    uint8_t gm_0d[0x100];
+    uint8_t gm_0e[0x100];
+    uint8_t gm_8d[0x100];
+    uint8_t gm_f6[0x100];
+
+    /* Node-local copy of the gm_* table 'id' */
+    const uint8_t* local(const GmTable id) const;
+};
+
+/* Node-local copy of the candidate space of one fault location */
+struct NodeData
+{
+    Tables t;
+
+    /* Pair and fault location */
+    uint8_t c[0x10];
+    uint8_t d[0x10];
+    size_t l;
+
+    /* Fault equations: inverse deltas (node-local tables and their constants), key byte and 9-th round key byte of each term */
+    const uint8_t* gm[0x4];
+    uint8_t g[0x4];
+    size_t x[0x10];
+    size_t y[0x10];
+
+    /* Column of each key byte and its position within the column tuple */
+    size_t col[0x10];
+    size_t pos[0x10];
+
+    /* Column tuples with isbox[c ^ k] and isbox[d ^ k] per tuple byte */
+    size_t n[0x4];
+    const uint8_t* v[0x4];
+    uint8_t* ic[0x4];
+    uint8_t* id[0x4];
+
+    /* Column 3 transposed and padded to 64 tuples: key byte, isbox[c ^ k], isbox[d ^ k] per position */
+    uint8_t* t3[0x3][0x4];
+};
+
+#define KERNELS(isa) \
+    void improved_kernel_##isa(const NodeData &x, const size_t b, const size_t e, Arena* a); \
+    void deltas_##isa(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r); \
+    size_t verify_keys_##isa(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct); \
+    void invert_key_schedule_##isa(const uint8_t* k10, uint8_t* mk, size_t n);
+
+KERNELS(sse)
+KERNELS(avx2)
+KERNELS(avx512)
+
+/* Scalar reference built on improved_filter(), see dfa.cpp */
+void reference_kernel(const NodeData &x, const size_t b, const size_t e, Arena* a);
+void reference_deltas(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r);
+void reference_invert(const uint8_t* k10, uint8_t* mk, size_t n);
+size_t reference_verify(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct);
+
+/* Inside a kernel translation unit the plain names refer to its own variant */
+#ifdef KERNEL_ISA
+#define KERNEL_CAT(f, isa) f##_##isa
+#define KERNEL_NAME(f, isa) KERNEL_CAT(f, isa)
+#define improved_kernel KERNEL_NAME(improved_kernel, KERNEL_ISA)
+#define deltas KERNEL_NAME(deltas, KERNEL_ISA)
+#define verify_keys KERNEL_NAME(verify_keys, KERNEL_ISA)
+#define invert_key_schedule KERNEL_NAME(invert_key_schedule, KERNEL_ISA)
+#define encrypt KERNEL_NAME(encrypt, KERNEL_ISA)
+#define decrypt KERNEL_NAME(decrypt, KERNEL_ISA)
+#define self_test KERNEL_NAME(self_test, KERNEL_ISA)
+#endif
+
+/* Set of kernels for one instruction set */
+struct Engine
+{
+    const char* name;
+    bool (*supported)();
+    void (*improved)(const NodeData &x, const size_t b, const size_t e, Arena* a);
+    void (*deltas)(const uint8_t* c, const uint8_t* d, const uint8_t* const* gm, uint8_t* r);
+    size_t (*verify)(const uint8_t* keys, size_t n, const uint8_t* pt, const uint8_t* ct);
+    void (*invert)(const uint8_t* k10, uint8_t* mk, size_t n);
+    bool reference;     // scalar code the others are checked against, never picked by default
+};
+
+const Engine &engine();
+
+const Engine &reference_engine();
+
+const Engine* find_engine(const char* name);
+
+bool select_engine(const char* name);
+
+void print_engines();
+
+#endif
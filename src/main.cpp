@@ -0,0 +1,485 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <memory>
+#include <time.h>
+
+#include "cache.hpp"
+#include "deadline.hpp"
+#include "dfa.hpp"
+#include "kernel.hpp"
+#include "net.hpp"
+#include "prof.hpp"
+#include "session.hpp"
+
+void help()
+{
+    printf("Usage: ./dfa [options] c l b f\n");
+    printf("%7s./dfa --worker[=port] c\n\n", "");
+    printf("Parameters\n");
+    printf("%2sc: Number of cores >= 1.\n", "");
+    printf("%2sl: Byte number of the AES state affected by the fault.\n%5sMust be in {-1, 0,..., 15}, where -1 means unknown.\n", "", "");
+    printf("%2sb: Indicate if a brute-force search is needed over remainding master keys.\n%5sMust be 'bf' or 'nobf'.\n", "", "");
+    printf("%2sf: Input file with one or more pairs of correct and faulty ciphertexts; and corresponding plaintext if 'bf'.\n\n","");
+    printf("Options\n");
+    printf("%2s--worker[=port]: Serve shards of the candidate space to a coordinator (default port %u).\n", "", DFA_PORT);
+    printf("%2s--workers=h1:p1,h2:p2,...: Coordinate, i.e. shard the improved filter over the given workers; a worker silent for\n%5s--worker-timeout=s seconds (default %u) is dropped and its shard reassigned. Only for the analysis of single pairs.\n", "", "", DFA_TIMEOUT);
+    printf("%2s--joint: All pairs share the same key; intersect their candidates and write 'res/joint.csv'.\n", "");
+    printf("%2s--model=round8|round9: Fault between the 7th and 8th round MixColumns (default), or right before the 9th round\n%5sMixColumns where l is the byte of its input; round9 analyses all pairs together and writes 'res/round9.csv'.\n", "", "");
+    printf("%2s--cache[=dir]: Keep the surviving 10th round keys of each pair and location in 'dir' (default 'cache')\n%5sand reuse them on repeated runs; --cache-size=MB limits the directory (default 1024), least recently used first.\n", "", "");
+    printf("%2s--triage: Only count the column candidates of every pair and location (standard filter) and write\n%5sthe keyspace sizes to 'res/triage.csv', for sorting out large corpora before the improved filter.\n", "", "");
+    printf("%2s--profile: Report hardware counters (cycles, instructions, L1D/LLC and branch misses) per stage and worker.\n", "");
+    printf("%2s--isa=avx512|avx2|sse|reference: Kernels to use instead of the best one supported by this CPU.\n", "");
+    printf("%2s--deadline=seconds: Work through all pairs and locations smallest keyspace first, write each key to 'res/deadline.csv'\n%5sas soon as it is found (verified if 'bf'), stop at the deadline and report what was not covered.\n", "", "");
+    printf("%2s--dry-run: Run the kernel on --samples=N (default 16, at least one per core) random column-0 slices of each pair and\n%5slocation and predict time, survivors and memory of the full run; written to 'res/dryrun.csv'. --seed=s as below.\n", "", "");
+    printf("%2s--verify-engine=name: Compare the survivors of engine 'name' with the scalar reference on --samples=N (default 16)\n%5srandom column-0 slices per pair and location, and report every mismatching candidate; the key schedule inversion and\n%5skey verification are checked on the survivors and random keys. --seed=s repeats a run (default: time).\n", "", "", "");
+    printf("%2s--session: Read pairs with the same correct ciphertext one by one from f ('-' for stdin),\n%5sreport the remaining keys after each and stop once the key is unique; writes 'res/session.csv'.\n\n", "", "");
+}
+
+/* Reads pairs one line at a time from 'file' ('-' for stdin) into an incremental session */
+int session(const string file, const size_t j, const size_t n, const size_t cores, int bf)
+{
+    ifstream infile;
+    if(file != "-")
+    {
+        infile.open(file);
+        if(!infile.is_open())
+        {
+            printerror();
+        }
+    }
+    istream &in = (file == "-") ? cin : infile;
+
+    unique_ptr<Session> s;
+    State c, p;
+    string line;
+    while(getline(in, line))
+    {
+        istringstream iin(line);
+        string x, y, z;
+        iin >> x >> y >> z;
+        if(x.length() != 0x20 || y.length() != 0x20)
+        {
+            continue;
+        }
+
+        State e, d;
+        for(size_t i = 0x0; i < 0x10; ++i)
+        {
+            e[i] = strtol(x.substr(0x2 * i, 0x2).c_str(), 0x0, 0x10);
+            d[i] = strtol(y.substr(0x2 * i, 0x2).c_str(), 0x0, 0x10);
+            p[i] = (bf && z.length() == 0x20) ? strtol(z.substr(0x2 * i, 0x2).c_str(), 0x0, 0x10) : 0x0;
+        }
+
+        if(!s)
+        {
+            c = e;
+            s.reset(new Session(c, j, n, cores));
+            printf("Session for correct ciphertext ");
+            printState(c);
+            printf("\nNumber of core(s): %lu \n", cores);
+        }
+        else if(e != c)
+        {
+            printf("Skipping pair with a different correct ciphertext\n");
+            continue;
+        }
+
+        const bool ok = s->add(d);
+        const size_t m = s->size();
+        printf("(%lu) ", s->pairs() + s->rejected() - 0x1);
+        printState(d);
+        if(ok)
+        {
+            printf(": %lu %s = 2^%f\n", m, s->exact() ? "keys" : "keys at most", log2(m));
+        }
+        else
+        {
+            printf(": rejected as a bad capture, %lu %s = 2^%f\n", m, s->exact() ? "keys" : "keys at most", log2(m));
+        }
+        fflush(stdout);
+
+        if(s->exact() && m <= 0x1)
+        {
+            printf("Key %s after %lu pairs, stop injecting.\n", m ? "unique" : "not found", s->pairs());
+            break;
+        }
+    }
+
+    if(!s)
+    {
+        return -0x1;
+    }
+
+    const string name = "res/session.csv";
+    FILE * outfile = fopen(name.c_str(), "w");
+    fclose(outfile);
+    vector<State> keys = s->keys();
+    writefile(p, c, keys, name);
+    if(bf)
+    {
+        bruteforce(name);
+    }
+    printf("\n\n%lu masterkeys written to %s\n\n", keys.size(), name.c_str());
+    return 0x0;
+}
+
+int main(int argc, char **argv)
+{
+    /* Separate options '--name=value' from the positional parameters */
+    map<string, string> opts;
+    vector<char*> args;
+    for(int i = 0x0; i < argc; ++i)
+    {
+        string a = argv[i];
+        if(i > 0x0 && a.compare(0x0, 0x2, "--") == 0x0)
+        {
+            size_t p = a.find('=');
+            opts[a.substr(0x2, p == string::npos ? string::npos : p - 0x2)] = p == string::npos ? "" : a.substr(p + 0x1);
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
+    /* Kernels for the instruction set of this CPU, or the one asked for */
+    if(opts.count("isa") && !select_engine(opts["isa"].c_str()))
+    {
+        printf("Unknown or unsupported instruction set '%s', available:\n", opts["isa"].c_str());
+        print_engines();
+        return -0x1;
+    }
+    printf("Engine: %s\n", engine().name);
+    profiling = opts.count("profile");
+    if(opts.count("cache"))
+    {
+        const string dir = opts["cache"].empty() ? "cache" : opts["cache"];
+        cache_open(dir, opts.count("cache-size") ? (size_t) atol(opts["cache-size"].c_str()) << 0x14 : CACHE_LIMIT);
+    }
+
+    /* Worker mode: serve shards of the candidate space to a coordinator */
+    if(opts.count("worker"))
+    {
+        if(args.size() != 0x2 || atoi(args[0x1]) < 0x1)
+        {
+            help();
+            return -0x1;
+        }
+        const string p = opts["worker"];
+        return worker(p.empty() ? DFA_PORT : atoi(p.c_str()), atoi(args[0x1]));
+    }
+
+    if(args.size() != 0x5)
+    {
+        help();
+        return -0x1;
+    }
+
+    const size_t c = atoi(args[0x1]);   // number of cores
+    const int l = atoi(args[0x2]);      // fault location
+    const char* b = args[0x3];          // brute-force
+    const string f = args[0x4];         // input file
+
+    const bool joint = opts.count("joint");   // all pairs share the same key
+    const string model = opts.count("model") ? opts["model"] : "round8";   // fault model
+
+    if(model != "round8" && model != "round9")
+    {
+        help();
+        return -0x1;
+    }
+
+    /* Coordinator mode: comma-separated list of workers */
+    vector<string> workers;
+    if(opts.count("workers"))
+    {
+        stringstream ws(opts["workers"]);
+        string w;
+        while(getline(ws, w, ','))
+        {
+            if(!w.empty())
+            {
+                workers.push_back(w);
+            }
+        }
+    }
+    const double timeout = opts.count("worker-timeout") ? atof(opts["worker-timeout"].c_str()) : DFA_TIMEOUT;
+
+    /* The workers only run the improved filter of single pairs */
+    const char* local[] = {"joint", "session", "triage", "dry-run", "deadline", "verify-engine"};
+    string clash = (model != "round8") ? "model=" + model : "";
+    for(size_t i = 0x0; i < sizeof(local) / sizeof(local[0x0]) && clash.empty(); ++i)
+    {
+        if(opts.count(local[i]))
+        {
+            clash = local[i];
+        }
+    }
+    if(!workers.empty() && !clash.empty())
+    {
+        printf("--workers cannot be combined with --%s\n\n", clash.c_str());
+        help();
+        return -0x1;
+    }
+
+    if(c < 0x0 || l < -0x1 || l > 0xf || (strcmp(b, "bf") && strcmp(b, "nobf")) || f.empty())
+    {
+        help();
+        return -0x1;
+    }
+
+    vector<pair<pair<State, State>, State>> pairs;
+    if(!opts.count("session"))
+    {
+        pairs = readfile(f, !strcmp(b, "bf"));
+    }
+
+    /* Set fault location range */
+    size_t j = 0x0;
+    size_t n = 0x0;
+    if(l == -0x1)
+    {
+        n = 16;
+    } else {
+        j = l;
+        n = l + 0x1;
+    }
+
+    /* Triage: keyspace sizes of all pairs and locations from the standard filter alone, written to 'res/triage.csv' */
+    if(opts.count("triage"))
+    {
+        const string name = "res/triage.csv";
+        double t0 = omp_get_wtime();
+        size_t valid = triage_corpus(pairs, j, n, c, name);
+        double t1 = omp_get_wtime();
+        printf("%lu of %lu pairs valid, %.3f s (%.0f pairs/minute), written to %s\n", valid, pairs.size(), t1 - t0,
+               60 * pairs.size() / max(t1 - t0, 1e-9), name.c_str());
+        return 0x0;
+    }
+
+    /* Random slices of the dry run and the engine check, repeatable with --seed */
+    if(opts.count("dry-run") || opts.count("verify-engine"))
+    {
+        const unsigned seed = opts.count("seed") ? strtoul(opts["seed"].c_str(), NULL, 0x0) : time(NULL);
+        printf("Seed: %u\n", seed);
+        srand(seed);
+    }
+
+    /* Dry run: predicted time, survivors and memory of every pair and location, also written to 'res/dryrun.csv' */
+    if(opts.count("dry-run"))
+    {
+        const size_t samples = opts.count("samples") ? atoi(opts["samples"].c_str()) : 0x10;
+        const string name = "res/dryrun.csv";
+        FILE * outfile = fopen(name.c_str(), "w");
+        if(outfile == NULL)
+        {
+            printerror();
+        }
+        fprintf(outfile, "pair,location,keyspace,sampled,rate,seconds,survivors,expected,memory\n");
+        double total = 0x0;
+        for(size_t i = 0x0; i < pairs.size(); ++i)
+        {
+            for(size_t m = j; m < n; ++m)
+            {
+                Estimate e = estimate(pairs[i].first.first, pairs[i].first.second, m, c, samples);
+                if(e.keyspace == 0x0)
+                {
+                    printf("(%lu) Location %lu: empty keyspace, the pair cannot stem from this location\n", i, m);
+                } else {
+                    printf("(%lu) Location %lu: keyspace 2^%.2f, %.3e candidates/s on %lu core(s), predicted %.1f s, ~%.0f survivors"
+                           " (%.0f expected), %.1f MiB\n", i, m, log2(e.keyspace), e.rate, c, e.seconds, e.survivors, e.expected,
+                           e.memory / 0x100000);
+                }
+                fprintf(outfile, "%lu,%lu,%.0f,%.0f,%.0f,%.3f,%.1f,%.1f,%.0f\n", i, m, e.keyspace, e.sampled, e.rate, e.seconds,
+                        e.survivors, e.expected, e.memory);
+                total += e.seconds;
+            }
+        }
+        fclose(outfile);
+        printf("\nPredicted total: %.1f s, written to %s\n", total, name.c_str());
+        return 0x0;
+    }
+
+    /* Time budget: smallest keyspaces first, keys written as they are found to 'res/deadline.csv' */
+    if(opts.count("deadline"))
+    {
+        deadline(pairs, j, n, c, atof(opts["deadline"].c_str()), !strcmp(b, "bf"), "res/deadline.csv");
+        return 0x0;
+    }
+
+    /* Cross-check of an engine against the scalar reference on sampled slices of each pair and location */
+    if(opts.count("verify-engine"))
+    {
+        const Engine* e = find_engine(opts["verify-engine"].c_str());
+        if(e == NULL)
+        {
+            printf("Unknown or unsupported engine '%s', available:\n", opts["verify-engine"].c_str());
+            print_engines();
+            return -0x1;
+        }
+        const size_t samples = opts.count("samples") ? atoi(opts["samples"].c_str()) : 0x10;
+        size_t bad = 0x0;
+        for(size_t i = 0x0; i < pairs.size(); ++i)
+        {
+            printf("(%lu) Verifying engine %s against the reference\n", i, e->name);
+            for(size_t m = j; m < n; ++m)
+            {
+                bad += verify_engine(*e, pairs[i].first.first, pairs[i].first.second, m, samples, c);
+            }
+        }
+        printf("\n%s\n", bad ? "ENGINE MISMATCH !!!" : "Engine output identical to the reference.");
+        return bad ? 0x1 : 0x0;
+    }
+
+    /* Round-9 fault model: all pairs are analysed together, written to 'res/round9.csv' */
+    if(model == "round9" && !pairs.empty())
+    {
+        vector<pair<State, State>> cts;
+        printf("Analysing %lu ciphertext pairs with round-9 faults under the same key\n", pairs.size());
+        printf("Number of core(s): %lu \n", c);
+        printf("----------------------------------------------------\n");
+        for(size_t i = 0x0; i < pairs.size(); ++i)
+        {
+            cts.push_back(pairs[i].first);
+        }
+
+        /* The correct key always survives, no keys means a column without usable pairs */
+        vector<State> keys = analyse_round9(cts, j, n, c);
+        if(keys.empty())
+        {
+            printf("ERROR: no round-9 key, nothing written !!!\n");
+            return 0x1;
+        }
+        const string name = "res/round9.csv";
+        FILE * outfile = fopen(name.c_str(), "w");
+        fclose(outfile);
+        writefile(pairs[0x0].second, pairs[0x0].first.first, keys, name);
+        if(!strcmp(b, "bf"))
+        {
+            bruteforce(name);
+        }
+        printf("\n\n%lu masterkeys written to %s\n\n", keys.size(), name.c_str());
+        return 0x0;
+    }
+
+    /* Session mode: narrow down the key pair by pair and stop as soon as it is unique */
+    if(opts.count("session"))
+    {
+        return session(f, j, n, c, !strcmp(b, "bf"));
+    }
+
+    /* Joint mode: one analysis of all pairs, written to 'res/joint.csv' */
+    if(joint && !pairs.empty())
+    {
+        vector<pair<State, State>> cts;
+        printf("Analysing %lu ciphertext pairs under the same key:\n\n", pairs.size());
+        for(size_t i = 0x0; i < pairs.size(); ++i)
+        {
+            printState(pairs[i].first.first);
+            printf(" ");
+            printState(pairs[i].first.second);
+            printf("\n");
+            cts.push_back(pairs[i].first);
+        }
+        printf("\nNumber of core(s): %lu \n", c);
+        printf("----------------------------------------------------\n");
+
+        vector<State> keys = analyse_joint(cts, j, n, c);
+        if(keys.empty())
+        {
+            return 0x1;
+        }
+        const string name = "res/joint.csv";
+        FILE * outfile = fopen(name.c_str(), "w");
+        fclose(outfile);
+        writefile(pairs[0x0].second, pairs[0x0].first.first, keys, name);
+        if(!strcmp(b, "bf"))
+        {
+            bruteforce(name);
+        }
+        printf("\n\n%lu masterkeys written to %s\n\n", keys.size(), name.c_str());
+        return 0x0;
+    }
+
+    vector<Located> common;
+    for(size_t i = 0x0; i < pairs.size(); ++i)
+    {
+        printf("(%lu) Analysing ciphertext pair:\n\n", i);
+        printState(pairs[i].first.first);
+        printf(" ");
+        printState(pairs[i].first.second);
+        printf("\n\nNumber of core(s): %lu \n", c);
+
+        /* Create new output file */
+        stringstream ss;
+        ss << "res/" << i << ".csv";
+        FILE * outfile;
+        const string name = ss.str();
+        outfile = fopen(name.c_str(), "w");
+        fclose(outfile);
+
+        /* Distribute all locations of this pair over the workers at once */
+        vector<vector<State>> sharded;
+        if(!workers.empty())
+        {
+            sharded = coordinate(pairs[i].first.first, pairs[i].first.second, j, n, workers, c, timeout);
+        }
+
+        vector<Located> located;
+        const size_t j0 = j;
+        while(j < n){
+            printf("----------------------------------------------------\n");
+            printf("Fault location: %lu\n", j);
+            vector<State> keys;
+            if(workers.empty())
+            {
+                keys = analyse(pairs[i].first.first, pairs[i].first.second, j, c);
+            }
+            else
+            {
+                vector<vector<State>> r(0x1, sharded[j - j0]);
+                keys = postproc(r);
+                printf("Size of keyspace: %lu = 2^%f \n", keys.size(), log2(keys.size()));
+            }
+            for(size_t m = 0x0; m < keys.size(); ++m)
+            {
+                Located x = {keys[m], (uint16_t) (0x1 << j)};
+                located.push_back(x);
+            }
+            j++;
+        }
+
+        /* One sorted, duplicate-free key list per pair, the locations of each key go to a sidecar file */
+        sort_keys(located, c);
+        vector<State> keys(located.size());
+        for(size_t m = 0x0; m < located.size(); ++m)
+        {
+            keys[m] = located[m].k;
+        }
+        writefile(pairs[i].second, pairs[i].first.first, keys, name);
+        stringstream ms;
+        ms << "res/" << i << ".mask.csv";
+        writemasks(located, ms.str());
+        common = (i == 0x0) ? located : intersect_keys(common, located);
+        if(l == -0x1)   // Reset j
+        {
+            j = 0x0;
+        }
+        else
+        {
+            j = l;
+        }
+        if(!strcmp(b, "bf"))
+        {
+            bruteforce(name);
+        }
+        printf("\n\n%lu masterkeys written to %s\n\n", keys.size(), name.c_str());
+    }
+    if(pairs.size() > 0x1)
+    {
+        printf("%lu masterkeys common to all pairs\n", common.size());
+    }
+    return 0x0;
+}
@@ -0,0 +1,429 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net.hpp"
+
+/* Wire format (all integers little-endian):
+ *   request:  "DFA1" | id (4) | l (1) | c (16) | d (16) | begin (4) | end (4)
+ *   response: "DFA1" | id (4) | n (4) | n 10-th round keys (16 each)
+ *   heartbeat: "DFAH" | id (4) | 0 (4), every DFA_HEARTBEAT seconds while the shard is computed
+ */
+static const uint8_t magic[0x4] = {'D', 'F', 'A', '1'};
+static const uint8_t beat[0x4] = {'D', 'F', 'A', 'H'};
+static const size_t REQUEST_SIZE = 0x31;
+static const size_t RESPONSE_SIZE = 0xc;
+
+static void put32(uint8_t* p, uint32_t x)
+{
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        p[i] = (x >> (0x8 * i)) & 0xff;
+    }
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0x0] | (p[0x1] << 0x8) | (p[0x2] << 0x10) | ((uint32_t) p[0x3] << 0x18);
+}
+
+/* Reads or writes exactly 'n' bytes, returns false on error or end of stream */
+static bool recv_all(int fd, uint8_t* p, size_t n)
+{
+    while(n > 0x0)
+    {
+        ssize_t r = read(fd, p, n);
+        if(r <= 0x0)
+        {
+            return false;
+        }
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const uint8_t* p, size_t n)
+{
+    while(n > 0x0)
+    {
+        ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+        if(r <= 0x0)
+        {
+            return false;
+        }
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+/* Connects to a worker given as 'host:port' (or 'host' for the default port), returns -1 on failure */
+static int connect_to(const string &worker)
+{
+    string host = worker;
+    string port = to_string(DFA_PORT);
+    size_t p = worker.rfind(':');
+    if(p != string::npos)
+    {
+        host = worker.substr(0x0, p);
+        port = worker.substr(p + 0x1);
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0x0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+    {
+        return -0x1;
+    }
+
+    int fd = -0x1;
+    for(struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0x0)
+        {
+            continue;
+        }
+        if(!connect(fd, ai->ai_addr, ai->ai_addrlen))
+        {
+            break;
+        }
+        close(fd);
+        fd = -0x1;
+    }
+    freeaddrinfo(res);
+
+    if(fd >= 0x0)
+    {
+        int one = 0x1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    }
+    return fd;
+}
+
+/* Applies the improved filter to the column-0 tuples [begin, end) of the keyspace of location 'l' */
+vector<State> run_shard(State &c, State &d, const Shard &s, const size_t cores)
+{
+    vector<VKeyTuple> cmb = columns(c, d, s.l);
+    size_t end = min<size_t>(s.end, cmb[0x0].size());
+    size_t begin = min<size_t>(s.begin, end);
+    cmb[0x0] = VKeyTuple(cmb[0x0].begin() + begin, cmb[0x0].begin() + end);
+    return search(c, d, cmb, s.l, cores);
+}
+
+/* Serves shards to coordinators until killed */
+int worker(const uint16_t port, const size_t cores)
+{
+    int srv = socket(AF_INET6, SOCK_STREAM, 0x0);
+    if(srv < 0x0)
+    {
+        perror("socket");
+        return -0x1;
+    }
+    int one = 0x1, zero = 0x0;
+    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(srv, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0x0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if(bind(srv, (struct sockaddr*) &addr, sizeof(addr)) || listen(srv, 0x10))
+    {
+        perror("bind");
+        close(srv);
+        return -0x1;
+    }
+    printf("Worker listening on port %u with %lu core(s)\n", port, cores);
+    fflush(stdout);
+
+    while(true)
+    {
+        int fd = accept(srv, NULL, NULL);
+        if(fd < 0x0)
+        {
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint8_t req[REQUEST_SIZE];
+        while(recv_all(fd, req, REQUEST_SIZE))
+        {
+            if(memcmp(req, magic, 0x4) || req[0x8] > 0xf)
+            {
+                fprintf(stderr, "Worker: malformed request\n");
+                break;
+            }
+
+            Shard s;
+            State c, d;
+            s.id = get32(req + 0x4);
+            s.l = req[0x8];
+            memcpy(c.data(), req + 0x9, 0x10);
+            memcpy(d.data(), req + 0x19, 0x10);
+            s.begin = get32(req + 0x29);
+            s.end = get32(req + 0x2d);
+
+            printf("Shard %u: location %u, column-0 tuples [%u, %u)\n", s.id, s.l, s.begin, s.end);
+            fflush(stdout);
+
+            /* Heartbeats while the shard is computed, so that the coordinator can tell a slow worker from a hung one */
+            future<vector<State>> f = async(launch::async, run_shard, ref(c), ref(d), cref(s), cores);
+            uint8_t hb[RESPONSE_SIZE];
+            memcpy(hb, beat, 0x4);
+            put32(hb + 0x4, s.id);
+            put32(hb + 0x8, 0x0);
+            bool alive = true;
+            while(f.wait_for(chrono::seconds(DFA_HEARTBEAT)) != future_status::ready)
+            {
+                alive = alive && send_all(fd, hb, RESPONSE_SIZE);
+            }
+            vector<State> k = f.get();
+            if(!alive)
+            {
+                break;
+            }
+
+            vector<uint8_t> res(RESPONSE_SIZE + 0x10 * k.size());
+            memcpy(res.data(), magic, 0x4);
+            put32(res.data() + 0x4, s.id);
+            put32(res.data() + 0x8, k.size());
+            for(size_t i = 0x0; i < k.size(); ++i)
+            {
+                memcpy(res.data() + RESPONSE_SIZE + 0x10 * i, k[i].data(), 0x10);
+            }
+            if(!send_all(fd, res.data(), res.size()))
+            {
+                break;
+            }
+        }
+        close(fd);
+    }
+    return 0x0;
+}
+
+/* Hands out shards to the workers, reassigns shards of lost workers and returns the survivors per shard id. A worker is lost
+ * when its connection fails, when it sends anything but a heartbeat or the result of its shard, or when it stays silent for
+ * 'timeout' seconds. */
+vector<vector<State>> dispatch(State &c, State &d, vector<Shard> &shards, const vector<string> &workers, const size_t cores,
+                              const double timeout)
+{
+    vector<vector<State>> r(shards.size());
+    deque<size_t> todo;
+    for(size_t i = 0x0; i < shards.size(); ++i)
+    {
+        shards[i].id = i;
+        todo.push_back(i);
+    }
+
+    /* Connected workers, the shard each one is busy with and when it was last heard of; reads and writes of a worker that
+     * stops in the middle of a message time out as well */
+    vector<int> fds;
+    vector<size_t> busy;
+    vector<string> names;
+    vector<double> seen;
+    struct timeval tv;
+    tv.tv_sec = (time_t) timeout;
+    tv.tv_usec = (suseconds_t) ((timeout - tv.tv_sec) * 1e6);
+    for(size_t i = 0x0; i < workers.size(); ++i)
+    {
+        int fd = connect_to(workers[i]);
+        if(fd < 0x0)
+        {
+            fprintf(stderr, "Worker %s unreachable\n", workers[i].c_str());
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        fds.push_back(fd);
+        busy.push_back(SIZE_MAX);
+        names.push_back(workers[i]);
+        seen.push_back(0x0);
+    }
+
+    size_t done = 0x0;
+    while(done < shards.size())
+    {
+        /* Keep every worker busy */
+        for(size_t i = 0x0; i < fds.size(); ++i)
+        {
+            while(busy[i] == SIZE_MAX && !todo.empty())
+            {
+                const Shard &s = shards[todo.front()];
+                uint8_t req[REQUEST_SIZE];
+                memcpy(req, magic, 0x4);
+                put32(req + 0x4, s.id);
+                req[0x8] = s.l;
+                memcpy(req + 0x9, c.data(), 0x10);
+                memcpy(req + 0x19, d.data(), 0x10);
+                put32(req + 0x29, s.begin);
+                put32(req + 0x2d, s.end);
+                if(!send_all(fds[i], req, REQUEST_SIZE))
+                {
+                    fprintf(stderr, "Worker %s lost\n", names[i].c_str());
+                    close(fds[i]);
+                    fds.erase(fds.begin() + i);
+                    busy.erase(busy.begin() + i);
+                    names.erase(names.begin() + i);
+                    seen.erase(seen.begin() + i);
+                    if(i == fds.size())
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                busy[i] = todo.front();
+                seen[i] = omp_get_wtime();
+                todo.pop_front();
+            }
+        }
+
+        /* No worker left: compute the remaining shards locally */
+        if(fds.empty())
+        {
+            while(!todo.empty())
+            {
+                fprintf(stderr, "Computing shard %lu locally\n", todo.front());
+                r[todo.front()] = run_shard(c, d, shards[todo.front()], cores);
+                todo.pop_front();
+                done++;
+            }
+            break;
+        }
+
+        /* Wait until a worker reports or the first busy one runs out of time */
+        double now = omp_get_wtime();
+        double wait = timeout;
+        vector<struct pollfd> pfds(fds.size());
+        for(size_t i = 0x0; i < fds.size(); ++i)
+        {
+            pfds[i].fd = fds[i];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0x0;
+            if(busy[i] != SIZE_MAX)
+            {
+                wait = min(wait, seen[i] + timeout - now);
+            }
+        }
+        if(poll(pfds.data(), pfds.size(), (int) (max(wait, 0.0) * 1e3) + 0x1) < 0x0)
+        {
+            continue;
+        }
+        now = omp_get_wtime();
+
+        /* Collect finished shards, iterating backwards so lost workers can be erased in place */
+        for(size_t i = fds.size(); i-- > 0x0;)
+        {
+            bool ok = true;
+            if(pfds[i].revents)
+            {
+                uint8_t res[RESPONSE_SIZE];
+                ok = recv_all(fds[i], res, RESPONSE_SIZE) && busy[i] != SIZE_MAX && get32(res + 0x4) == busy[i];
+                if(ok && !memcmp(res, beat, 0x4))
+                {
+                    seen[i] = now;
+                    continue;
+                }
+                ok = ok && !memcmp(res, magic, 0x4);
+
+                /* Never more survivors than candidates, read in blocks so that only keys actually sent take memory */
+                const size_t m = ok ? get32(res + 0x8) : 0x0;
+                ok = ok && m <= shards[busy[i]].keyspace;
+                vector<State> k;
+                for(size_t j = 0x0; ok && j < m; j += 0x10000)
+                {
+                    const size_t e = min(m, j + 0x10000);
+                    k.resize(e);
+                    ok = recv_all(fds[i], k[j].data(), 0x10 * (e - j));
+                }
+
+                if(ok)
+                {
+                    r[busy[i]] = k;
+                    busy[i] = SIZE_MAX;
+                    done++;
+                    continue;
+                }
+            }
+            else if(busy[i] == SIZE_MAX || now - seen[i] < timeout)
+            {
+                continue;
+            }
+
+            /* Worker lost or silent for too long: give its shard to somebody else */
+            fprintf(stderr, "Worker %s %s\n", names[i].c_str(), ok ? "timed out" : "lost");
+            if(busy[i] != SIZE_MAX)
+            {
+                fprintf(stderr, "Reassigning shard %lu\n", busy[i]);
+                todo.push_front(busy[i]);
+            }
+            close(fds[i]);
+            fds.erase(fds.begin() + i);
+            busy.erase(busy.begin() + i);
+            names.erase(names.begin() + i);
+            seen.erase(seen.begin() + i);
+        }
+    }
+
+    for(size_t i = 0x0; i < fds.size(); ++i)
+    {
+        close(fds[i]);
+    }
+    return r;
+}
+
+/* Shards the candidate spaces of the fault locations j, ..., n - 1 and returns the surviving 10-th round keys per location */
+vector<vector<State>> coordinate(State &c, State &d, const size_t j, const size_t n, const vector<string> &workers, const size_t cores,
+                                 const double timeout)
+{
+    vector<Shard> shards;
+    for(size_t l = j; l < n; ++l)
+    {
+        vector<VKeyTuple> cmb = columns(c, d, l);
+        size_t m = cmb[0x0].size();
+        size_t k = cmb[0x1].size() * cmb[0x2].size() * cmb[0x3].size();
+        printf("Fault location %lu: keyspace %lu = 2^%f\n", l, m * k, log2(m * k));
+
+        /* About four shards per worker and location to balance uneven workers */
+        size_t w = max<size_t>(0x1, m / (0x4 * max<size_t>(0x1, workers.size())));
+        for(size_t b = 0x0; b < m; b += w)
+        {
+            Shard s;
+            s.id = 0x0;
+            s.l = l;
+            s.begin = b;
+            s.end = min(m, b + w);
+            s.keyspace = (uint64_t) (s.end - s.begin) * k;
+            shards.push_back(s);
+        }
+    }
+    printf("Dispatching %lu shards to %lu worker(s).", shards.size(), workers.size());
+    fflush(stdout);
+
+    vector<vector<State>> r = dispatch(c, d, shards, workers, cores, timeout);
+    printf("Done.\n");
+
+    /* Merge survivors in shard order, i.e. by location and column-0 tuple */
+    vector<vector<State>> k(n - j);
+    for(size_t i = 0x0; i < shards.size(); ++i)
+    {
+        k[shards[i].l - j].insert(k[shards[i].l - j].end(), r[i].begin(), r[i].end());
+    }
+    return k;
+}
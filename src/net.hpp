@@ -0,0 +1,37 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#include "dfa.hpp"
+
+/* Default TCP port of a worker */
+#define DFA_PORT 0x1b59
+
+/* Seconds between two heartbeats of a busy worker, and of silence after which the coordinator gives up on it (default) */
+#define DFA_HEARTBEAT 0x5
+#define DFA_TIMEOUT 0x1e
+
+/* Shard of the candidate space: a fault location and a range [begin, end) of column-0 tuples */
+struct Shard
+{
+    uint32_t id;
+    uint8_t l;
+    uint32_t begin;
+    uint32_t end;
+    uint64_t keyspace;  // candidates in the shard, bounds the number of survivors a worker may report
+};
+
+int worker(const uint16_t port, const size_t cores);
+
+vector<vector<State>> coordinate(State &c, State &d, const size_t j, const size_t n, const vector<string> &workers, const size_t cores,
+                                 const double timeout = DFA_TIMEOUT);
+
+vector<vector<State>> dispatch(State &c, State &d, vector<Shard> &shards, const vector<string> &workers, const size_t cores,
+                              const double timeout = DFA_TIMEOUT);
+
+vector<State> run_shard(State &c, State &d, const Shard &s, const size_t cores);
+
+#endif
@@ -0,0 +1,334 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <dirent.h>
+#include <sys/mman.h>
+
+#include "numa.hpp"
+
+static const size_t ARENA_BLOCK = HUGE_PAGE / sizeof(State);
+
+static int read_int(const string file, int fallback)
+{
+    ifstream in(file);
+    int x;
+    if(in >> x)
+    {
+        return x;
+    }
+    return fallback;
+}
+
+/* NUMA node of a cpu, i.e. the 'nodeN' entry in its sysfs directory */
+static int cpu_node(int cpu)
+{
+    stringstream ss;
+    ss << "/sys/devices/system/cpu/cpu" << cpu;
+    DIR* dir = opendir(ss.str().c_str());
+    if(dir == NULL)
+    {
+        return 0x0;
+    }
+    int node = 0x0;
+    for(struct dirent* e = readdir(dir); e != NULL; e = readdir(dir))
+    {
+        if(!strncmp(e->d_name, "node", 0x4) && e->d_name[0x4] >= '0' && e->d_name[0x4] <= '9')
+        {
+            node = atoi(e->d_name + 0x4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+Affinity::Affinity()
+{
+    CPU_ZERO(&set);
+    valid = sched_getaffinity(0x0, sizeof(set), &set) == 0x0;
+}
+
+Affinity::~Affinity()
+{
+    if(valid)
+    {
+        sched_setaffinity(0x0, sizeof(set), &set);
+    }
+}
+
+/* CPUs the calling thread may run on, none if they cannot be read (e.g. more than CPU_SETSIZE cpus) */
+vector<Cpu> topology()
+{
+    vector<Cpu> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0x0, sizeof(set), &set) != 0x0)
+    {
+        return cpus;
+    }
+
+    for(int i = 0x0; i < CPU_SETSIZE; ++i)
+    {
+        if(!CPU_ISSET(i, &set))
+        {
+            continue;
+        }
+        stringstream ss;
+        ss << "/sys/devices/system/cpu/cpu" << i << "/topology/";
+        Cpu x;
+        x.id = i;
+        x.node = cpu_node(i);
+        x.core = read_int(ss.str() + "core_id", i);
+        x.package = read_int(ss.str() + "physical_package_id", 0x0);
+        cpus.push_back(x);
+    }
+    return cpus;
+}
+
+/* CPUs for 'threads' workers: one hardware thread per physical core first, alternating between the NUMA nodes, then the SMT
+ * siblings; none if the topology is unknown, the workers then stay unpinned */
+vector<Cpu> placement(const size_t threads)
+{
+    vector<Cpu> cpus = topology();
+
+    /* Rank each cpu among the hardware threads of its core */
+    map<pair<int, int>, int> seen;
+    vector<pair<pair<int, pair<int, int>>, size_t>> order;
+    map<int, int> per_node;
+    for(size_t i = 0x0; i < cpus.size(); ++i)
+    {
+        int smt = seen[make_pair(cpus[i].package, cpus[i].core)]++;
+        int slot = (smt == 0x0) ? per_node[cpus[i].node]++ : 0x0;
+        order.push_back(make_pair(make_pair(smt, make_pair(slot, cpus[i].node)), i));
+    }
+    sort(order.begin(), order.end());
+
+    vector<Cpu> r;
+    for(size_t i = 0x0; i < threads && !order.empty(); ++i)
+    {
+        r.push_back(cpus[order[i % order.size()].second]);
+    }
+    return r;
+}
+
+/* Pins the calling thread to a cpu */
+void pin(const int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0x0, sizeof(set), &set);
+}
+
+/* Memory that is placed on the node of the first thread touching it, backed by huge pages where available */
+void* alloc_node(const size_t size)
+{
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(size % HUGE_PAGE == 0x0)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -0x1, 0x0);
+    }
+#endif
+    if(p == MAP_FAILED)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -0x1, 0x0);
+        if(p == MAP_FAILED)
+        {
+            printf("ERROR !!!\n");
+            exit(0x1);
+        }
+#ifdef MADV_HUGEPAGE
+        if(size >= HUGE_PAGE)
+        {
+            madvise(p, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    return p;
+}
+
+void free_node(void* p, const size_t size)
+{
+    munmap(p, size);
+}
+
+const uint8_t* Tables::local(const GmTable id) const
+{
+    switch(id)
+    {
+        case GM_09: return gm_09;
+        case GM_0B: return gm_0b;
+        case GM_0D: return gm_0d;
+        case GM_0E: return gm_0e;
+        case GM_8D: return gm_8d;
+        case GM_F6: return gm_f6;
+        default: return gm_01;
+    }
+}
+
+/* Bytes of node data for column tuple counts 'n', column 3 padded to a multiple of 64 for the vector kernel */
+size_t node_size(const size_t* n)
+{
+    size_t size = sizeof(NodeData);
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        size += n[i] * 0xc;
+    }
+    return size + 0xc * ((n[0x3] + 0x3f) & ~(size_t) 0x3f);
+}
+
+/* Copies tables and column candidates of the calling thread's node, to be called by a thread pinned to that node */
+NodeData* node_data(State &c, State &d, vector<VKeyTuple> &cmb, const size_t l)
+{
+    size_t n[0x4];
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        n[i] = cmb[i].size();
+    }
+    const size_t size = node_size(n);
+    uint8_t* p = (uint8_t*) alloc_node(size);
+    memset(p, 0x0, size);
+
+    NodeData* x = (NodeData*) p;
+    p += sizeof(NodeData);
+    memcpy(x->t.sbox, sbox, 0x100);
+    memcpy(x->t.isbox, isbox, 0x100);
+    memcpy(x->t.gm_01, gm_01, 0x100);
+    memcpy(x->t.gm_09, gm_09, 0x100);
+    memcpy(x->t.gm_0b, gm_0b, 0x100);
+    memcpy(x->t.gm_0d, gm_0d, 0x100);
+    memcpy(x->t.gm_0e, gm_0e, 0x100);
+    memcpy(x->t.gm_8d, gm_8d, 0x100);
+    memcpy(x->t.gm_f6, gm_f6, 0x100);
+
+    memcpy(x->c, c.data(), 0x10);
+    memcpy(x->d, d.data(), 0x10);
+    x->l = l;
+
+    /* Configure fault equations depending on the fault location 'l' */
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        x->gm[i] = x->t.local(ideltas2_id[l % 0x4][i]);
+        x->g[i] = ideltas2[l % 0x4][i][0x1];
+        for(size_t m = 0x0; m < 0x4; ++m)
+        {
+            x->col[rb[i][m]] = i;
+            x->pos[rb[i][m]] = m;
+        }
+    }
+    for(size_t s = 0x0; s < 0x10; ++s)
+    {
+        x->x[s] = indices_x[map_fault[l]][s];
+        x->y[s] = indices_y[map_fault[l]][s];
+    }
+
+    for(size_t i = 0x0; i < 0x4; ++i)
+    {
+        uint8_t* v = p;
+        x->n[i] = n[i];
+        x->v[i] = v;
+        p += n[i] * 0x4;
+        x->ic[i] = p;
+        p += n[i] * 0x4;
+        x->id[i] = p;
+        p += n[i] * 0x4;
+
+        for(size_t j = 0x0; j < n[i]; ++j)
+        {
+            for(size_t m = 0x0; m < 0x4; ++m)
+            {
+                v[0x4 * j + m] = cmb[i][j][m];
+                x->ic[i][0x4 * j + m] = isbox[c[rb[i][m]] ^ cmb[i][j][m]];
+                x->id[i][0x4 * j + m] = isbox[d[rb[i][m]] ^ cmb[i][j][m]];
+            }
+        }
+    }
+
+    const size_t n3 = (n[0x3] + 0x3f) & ~(size_t) 0x3f;
+    for(size_t q = 0x0; q < 0x3; ++q)
+    {
+        const uint8_t* src = (q == 0x0) ? x->v[0x3] : (q == 0x1) ? x->ic[0x3] : x->id[0x3];
+        for(size_t m = 0x0; m < 0x4; ++m)
+        {
+            x->t3[q][m] = p;
+            p += n3;
+            for(size_t j = 0x0; j < n[0x3]; ++j)
+            {
+                x->t3[q][m][j] = src[0x4 * j + m];
+            }
+        }
+    }
+    return x;
+}
+
+void free_node_data(NodeData* x)
+{
+    free_node(x, node_size(x->n));
+}
+
+/* C entry of Arena::push() for the kernels, which do not see the class */
+void arena_push(Arena* a, const uint8_t* k)
+{
+    a->push(k);
+}
+
+Arena::Arena() : p(NULL), n(0x0), cap(0x0)
+{
+}
+
+Arena::~Arena()
+{
+    for(size_t i = 0x0; i < blocks.size(); ++i)
+    {
+        free_node(blocks[i].first, ARENA_BLOCK * sizeof(State));
+    }
+}
+
+/* Maps the first block ahead of the first push, e.g. outside a timed region */
+void Arena::reserve()
+{
+    if(p == NULL)
+    {
+        p = (State*) alloc_node(ARENA_BLOCK * sizeof(State));
+        blocks.push_back(make_pair(p, (size_t) 0x0));
+        cap = ARENA_BLOCK;
+    }
+}
+
+/* Bumps into the current block, a full block is kept and a new one started (no reallocation) */
+void Arena::push(const uint8_t* k)
+{
+    if(n == cap)
+    {
+        if(p != NULL)
+        {
+            blocks.back().second = n;
+        }
+        p = (State*) alloc_node(ARENA_BLOCK * sizeof(State));
+        blocks.push_back(make_pair(p, (size_t) 0x0));
+        n = 0x0;
+        cap = ARENA_BLOCK;
+    }
+    memcpy(p[n++].data(), k, 0x10);
+}
+
+size_t Arena::size() const
+{
+    size_t m = 0x0;
+    for(size_t i = 0x0; i + 0x1 < blocks.size(); ++i)
+    {
+        m += blocks[i].second;
+    }
+    return m + n;
+}
+
+void Arena::append(vector<State> &r) const
+{
+    for(size_t i = 0x0; i < blocks.size(); ++i)
+    {
+        size_t m = (i + 0x1 == blocks.size()) ? n : blocks[i].second;
+        r.insert(r.end(), blocks[i].first, blocks[i].first + m);
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <sched.h>
+
+#include "dfa.hpp"
+#include "kernel.hpp"
+
+/* Size of a huge page, which is also the size of the survivor blocks of an arena */
+static const size_t HUGE_PAGE = 0x200000;
+
+/* Logical CPU with its NUMA node, physical core and socket */
+struct Cpu
+{
+    int id;
+    int node;
+    int core;
+    int package;
+};
+
+/* Per-thread bump allocator for survivors, on its own cache lines to avoid false sharing */
+struct alignas(0x40) Arena
+{
+    vector<pair<State*, size_t>> blocks;
+    State* p;
+    size_t n;
+    size_t cap;
+
+    Arena();
+    ~Arena();
+    void reserve();
+    void push(const uint8_t* k);
+    size_t size() const;
+    void append(vector<State> &r) const;
+};
+
+/* Saves the affinity of the calling thread and restores it when going out of scope, on that same thread */
+struct Affinity
+{
+    cpu_set_t set;
+    bool valid;
+
+    Affinity();
+    ~Affinity();
+};
+
+vector<Cpu> topology();
+
+vector<Cpu> placement(const size_t threads);
+
+void pin(const int cpu);
+
+void* alloc_node(const size_t size);
+
+void free_node(void* p, const size_t size);
+
+size_t node_size(const size_t* n);
+
+NodeData* node_data(State &c, State &d, vector<VKeyTuple> &cmb, const size_t l);
+
+void free_node_data(NodeData* x);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "prof.hpp"
+
+bool profiling = false;
+
+static const uint32_t types[N_EVENTS] =
+{
+    PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+};
+
+static const uint64_t configs[N_EVENTS] =
+{
+    PERF_COUNT_SW_TASK_CLOCK,
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 0x8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 0x10),
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+Counters::Counters()
+{
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        v[i] = -0x1;
+    }
+}
+
+Counters &Counters::operator+=(const Counters &x)
+{
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        if(x.v[i] >= 0x0)
+        {
+            v[i] = (v[i] < 0x0 ? 0x0 : v[i]) + x.v[i];
+        }
+    }
+    return *this;
+}
+
+/* Events the kernel or the (virtual) machine does not offer are left out, user space only so that perf_event_paranoid=2 suffices */
+Perf::Perf()
+{
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        fd[i] = -0x1;
+        if(!profiling)
+        {
+            continue;
+        }
+        struct perf_event_attr a;
+        memset(&a, 0x0, sizeof(a));
+        a.size = sizeof(a);
+        a.type = types[i];
+        a.config = configs[i];
+        a.exclude_kernel = 0x1;
+        a.exclude_hv = 0x1;
+        a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd[i] = syscall(__NR_perf_event_open, &a, 0x0, -0x1, -0x1, 0x0);
+    }
+}
+
+Perf::~Perf()
+{
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        if(fd[i] >= 0x0)
+        {
+            close(fd[i]);
+        }
+    }
+}
+
+/* Values scaled up for the time an event was multiplexed out */
+Counters Perf::stop()
+{
+    Counters x;
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        if(fd[i] >= 0x0)
+        {
+            ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0x0);
+        }
+    }
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        uint64_t r[0x3];
+        if(fd[i] >= 0x0 && read(fd[i], r, sizeof(r)) == sizeof(r))
+        {
+            x.v[i] = (r[0x2] > 0x0 && r[0x2] < r[0x1]) ? (int64_t) ((double) r[0x0] * r[0x1] / r[0x2]) : (int64_t) r[0x0];
+        }
+    }
+    return x;
+}
+
+static void value(const char* name, const int64_t x)
+{
+    if(x >= 0x0)
+    {
+        printf(", %s %.3e", name, (double) x);
+    }
+    else
+    {
+        printf(", %s n/a", name);
+    }
+}
+
+/* One line per stage or worker with cycles per candidate, IPC and the effective clock rate */
+void report(const char* name, const Counters &x, const double candidates)
+{
+    const int64_t* v = x.v;
+    printf("  [profile] %s: %.3e candidates", name, candidates);
+    bool any = false;
+    for(size_t i = 0x0; i < N_EVENTS; ++i)
+    {
+        any |= v[i] >= 0x0;
+    }
+    if(!any)
+    {
+        printf(", counters unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+        return;
+    }
+    if(v[0x0] >= 0x0)
+    {
+        printf(", %.3f s", v[0x0] / 1e9);
+    }
+    value("cycles", v[0x1]);
+    value("instructions", v[0x2]);
+    value("L1D misses", v[0x3]);
+    value("LLC misses", v[0x4]);
+    value("branch misses", v[0x5]);
+    if(v[0x1] >= 0x0 && candidates > 0x0)
+    {
+        printf(", %.2f cycles/candidate", v[0x1] / candidates);
+    }
+    if(v[0x1] > 0x0 && v[0x2] >= 0x0)
+    {
+        printf(", IPC %.2f", (double) v[0x2] / v[0x1]);
+    }
+    if(v[0x1] >= 0x0 && v[0x0] > 0x0)
+    {
+        printf(", %.2f GHz", (double) v[0x1] / v[0x0]);
+    }
+    printf("\n");
+}
@@ -0,0 +1,37 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include "dfa.hpp"
+
+/* Counted events: task clock (ns), cycles, instructions, L1D load misses, LLC misses, branch misses */
+static const size_t N_EVENTS = 0x6;
+
+/* Counter values of one stage or worker, -1 where the event is not available */
+struct Counters
+{
+    int64_t v[N_EVENTS];
+
+    Counters();
+    Counters &operator+=(const Counters &x);
+};
+
+/* Hardware counters of the calling thread, counting from construction to stop(); no-op unless profiling */
+struct Perf
+{
+    int fd[N_EVENTS];
+
+    Perf();
+    ~Perf();
+    Counters stop();
+};
+
+/* Set by '--profile' */
+extern bool profiling;
+
+void report(const char* name, const Counters &x, const double candidates);
+
+#endif
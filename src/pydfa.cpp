@@ -0,0 +1,252 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+/* Python bindings: pydfa.analyse(c, d, l=-1, cores=0, joint=False, verbose=False)
+ *
+ * 'c' and 'd' are contiguous (N, 16) uint8 arrays, or flat ones of N * 16 bytes, of correct and faulty ciphertexts; other
+ * item types are rejected. The GIL is released while the analysis runs, progress goes to stdout only if 'verbose'. The
+ * result is one KeyBuffer per pair (a single one if 'joint'): it takes over the sorted, duplicate-free master keys and their
+ * location masks as the analysis left them and exports the keys as a (M, 16) uint8 buffer with a row stride of
+ * sizeof(Located), so numpy.asarray() views them without a copy. Bit l of keys.masks()[i] is set if fault location l
+ * produced key i. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "dfa.hpp"
+
+/* Master keys owned by a Python object */
+struct KeyBuffer
+{
+    PyObject_HEAD
+    vector<Located>* keys;
+    Py_ssize_t shape[0x2];
+    Py_ssize_t strides[0x2];
+};
+
+static PyTypeObject KeyBufferType = {PyVarObject_HEAD_INIT(NULL, 0x0)};
+
+static PyObject* keybuffer_new(vector<Located> &v)
+{
+    KeyBuffer* x = PyObject_New(KeyBuffer, &KeyBufferType);
+    if(x == NULL)
+    {
+        return NULL;
+    }
+    x->keys = new vector<Located>(move(v));
+    x->shape[0x0] = x->keys->size();
+    x->shape[0x1] = 0x10;
+    x->strides[0x0] = sizeof(Located);
+    x->strides[0x1] = 0x1;
+    return (PyObject*) x;
+}
+
+static void keybuffer_dealloc(KeyBuffer* x)
+{
+    delete x->keys;
+    PyObject_Del(x);
+}
+
+/* Read-only (M, 16) view of the keys, valid as long as the KeyBuffer lives (the exporter is referenced by the view). The rows
+ * are sizeof(Located) apart, so consumers have to accept strides. */
+static int keybuffer_getbuffer(KeyBuffer* x, Py_buffer* view, int flags)
+{
+    static Located empty;
+    if(flags & PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "KeyBuffer is read-only");
+        return -0x1;
+    }
+    if((flags & PyBUF_STRIDES) != PyBUF_STRIDES && x->keys->size() > 0x1)
+    {
+        PyErr_SetString(PyExc_BufferError, "KeyBuffer is strided");
+        return -0x1;
+    }
+    view->obj = (PyObject*) x;
+    Py_INCREF(x);
+    view->buf = x->keys->empty() ? empty.k.data() : x->keys->data()->k.data();
+    view->len = x->keys->size() * 0x10;
+    view->readonly = 0x1;
+    view->itemsize = 0x1;
+    view->format = (flags & PyBUF_FORMAT) ? (char*) "B" : NULL;
+    view->ndim = (flags & PyBUF_ND) ? 0x2 : 0x1;
+    view->shape = (flags & PyBUF_ND) ? x->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? x->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0x0;
+}
+
+static PyBufferProcs keybuffer_as_buffer = {(getbufferproc) keybuffer_getbuffer, NULL};
+
+static Py_ssize_t keybuffer_len(KeyBuffer* x)
+{
+    return x->keys->size();
+}
+
+static PySequenceMethods keybuffer_as_sequence = {(lenfunc) keybuffer_len};
+
+static PyObject* keybuffer_masks(KeyBuffer* x, PyObject* unused)
+{
+    PyObject* r = PyList_New(x->keys->size());
+    for(size_t i = 0x0; r != NULL && i < x->keys->size(); ++i)
+    {
+        PyList_SET_ITEM(r, i, PyLong_FromLong((*x->keys)[i].mask));
+    }
+    return r;
+}
+
+static PyMethodDef keybuffer_methods[] =
+{
+    {"masks", (PyCFunction) keybuffer_masks, METH_NOARGS, "Fault locations of each key as bitmasks."},
+    {NULL, NULL, 0x0, NULL}
+};
+
+/* Ciphertexts of an object exporting a contiguous (N, 16) array of unsigned bytes, or a flat one of N * 16 */
+static bool ciphertexts(PyObject* o, vector<State> &v)
+{
+    Py_buffer b;
+    if(PyObject_GetBuffer(o, &b, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0x0)
+    {
+        return false;
+    }
+    const bool bytes = b.itemsize == 0x1 && (b.format == NULL || !strcmp(b.format, "B"));
+    const bool shape = (b.ndim == 0x2 && b.shape[0x1] == 0x10) || (b.ndim == 0x1 && b.len % 0x10 == 0x0);
+    if(!bytes || !shape)
+    {
+        PyBuffer_Release(&b);
+        PyErr_Format(PyExc_TypeError, "ciphertexts must be a (N, 16) array of unsigned bytes, not format '%s' with %d dimension(s)",
+                     b.format == NULL ? "B" : b.format, b.ndim);
+        return false;
+    }
+    v.resize(b.len / 0x10);
+    memcpy(v.data(), b.buf, b.len);
+    PyBuffer_Release(&b);
+    return true;
+}
+
+static PyObject* py_analyse(PyObject* self, PyObject* args, PyObject* kw)
+{
+    static const char* names[] = {"c", "d", "l", "cores", "joint", "verbose", NULL};
+    PyObject* oc;
+    PyObject* od;
+    int l = -0x1;
+    int cores = 0x0;
+    int joint = 0x0;
+    int talk = 0x0;
+    if(!PyArg_ParseTupleAndKeywords(args, kw, "OO|iipp", (char**) names, &oc, &od, &l, &cores, &joint, &talk))
+    {
+        return NULL;
+    }
+
+    vector<State> c, d;
+    if(!ciphertexts(oc, c) || !ciphertexts(od, d))
+    {
+        return NULL;
+    }
+    if(c.size() != d.size() || l < -0x1 || l > 0xf)
+    {
+        PyErr_SetString(PyExc_ValueError, "c and d must have the same shape (N, 16) and l must be in {-1, 0, ..., 15}");
+        return NULL;
+    }
+    const size_t n_cores = (cores > 0x0) ? cores : omp_get_num_procs();
+    const size_t j = (l == -0x1) ? 0x0 : l;
+    const size_t n = (l == -0x1) ? 0x10 : l + 0x1;
+
+    vector<vector<Located>> r;
+    verbose = talk;
+    Py_BEGIN_ALLOW_THREADS
+    if(joint)
+    {
+        vector<pair<State, State>> pairs;
+        for(size_t i = 0x0; i < c.size(); ++i)
+        {
+            pairs.push_back(make_pair(c[i], d[i]));
+        }
+        vector<State> keys = pairs.empty() ? vector<State>() : analyse_joint(pairs, j, n, n_cores);
+        r.push_back(vector<Located>());
+        for(size_t m = 0x0; m < keys.size(); ++m)
+        {
+            Located x = {keys[m], (uint16_t) (((0x1 << n) - 0x1) & ~((0x1 << j) - 0x1))};
+            r.back().push_back(x);
+        }
+        sort_keys(r.back(), n_cores);
+    }
+    else
+    {
+        for(size_t i = 0x0; i < c.size(); ++i)
+        {
+            r.push_back(vector<Located>());
+            for(size_t m = j; m < n; ++m)
+            {
+                vector<State> keys = analyse(c[i], d[i], m, n_cores);
+                for(size_t k = 0x0; k < keys.size(); ++k)
+                {
+                    Located x = {keys[k], (uint16_t) (0x1 << m)};
+                    r.back().push_back(x);
+                }
+            }
+            sort_keys(r.back(), n_cores);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    PyObject* list = PyList_New(r.size());
+    for(size_t i = 0x0; list != NULL && i < r.size(); ++i)
+    {
+        PyObject* x = keybuffer_new(r[i]);
+        if(x == NULL)
+        {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, x);
+    }
+    return list;
+}
+
+static PyObject* py_engine(PyObject* self, PyObject* args)
+{
+    const char* name = NULL;
+    if(!PyArg_ParseTuple(args, "|s", &name))
+    {
+        return NULL;
+    }
+    if(name != NULL && !select_engine(name))
+    {
+        PyErr_Format(PyExc_ValueError, "unknown or unsupported engine '%s'", name);
+        return NULL;
+    }
+    return PyUnicode_FromString(engine().name);
+}
+
+static PyMethodDef methods[] =
+{
+    {"analyse", (PyCFunction) py_analyse, METH_VARARGS | METH_KEYWORDS,
+     "analyse(c, d, l=-1, cores=0, joint=False, verbose=False) -> list of KeyBuffer with the remaining master keys."},
+    {"engine", py_engine, METH_VARARGS, "engine([name]) -> name of the engine in use, after selecting 'name' if given."},
+    {NULL, NULL, 0x0, NULL}
+};
+
+static struct PyModuleDef module =
+{
+    PyModuleDef_HEAD_INIT, "pydfa", "DFA of AES-128 with a single fault injection.", -0x1, methods
+};
+
+PyMODINIT_FUNC PyInit_pydfa(void)
+{
+    KeyBufferType.tp_name = "pydfa.KeyBuffer";
+    KeyBufferType.tp_basicsize = sizeof(KeyBuffer);
+    KeyBufferType.tp_dealloc = (destructor) keybuffer_dealloc;
+    KeyBufferType.tp_as_buffer = &keybuffer_as_buffer;
+    KeyBufferType.tp_as_sequence = &keybuffer_as_sequence;
+    KeyBufferType.tp_methods = keybuffer_methods;
+    KeyBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+    KeyBufferType.tp_doc = "Master keys as a read-only (M, 16) uint8 buffer.";
+    if(PyType_Ready(&KeyBufferType) < 0x0)
+    {
+        return NULL;
+    }
+    return PyModule_Create(&module);
+}
@@ -0,0 +1,158 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#include "session.hpp"
+
+/* 'limit' is the size of the column product up to which the improved filter runs right away */
+Session::Session(const State &c, const size_t j, const size_t n, const size_t cores, const size_t limit)
+    : c(c), j(j), n(n), cores(cores), limit(limit), count(0x0), bad(0x0), filtered(false)
+{
+}
+
+/* Size of the product of column candidates */
+static size_t product(const vector<VKeyTuple> &x)
+{
+    return x.empty() ? 0x0 : x[0x0].size() * x[0x1].size() * x[0x2].size() * x[0x3].size();
+}
+
+bool Session::add(const State &d)
+{
+    /* Bad captures are spotted from the candidate counts alone: not a round-8 fault, or no candidates at any location */
+    Triage t = triage(c, d);
+    bool any = false;
+    for(size_t l = j; l < n && t.valid; ++l)
+    {
+        const uint64_t* x = t.n[map_fault[l]];
+        any |= x[0x0] * x[0x1] * x[0x2] * x[0x3] > 0x0;
+    }
+    if(!any)
+    {
+        bad++;
+        return false;
+    }
+
+    State e = d;
+    vector<vector<VKeyTuple>> v;
+    vector<VKeyTuple> u = candidates(c, e, j, n, v);
+
+    if(filtered)
+    {
+        /* Filter only the survivors with the new pair */
+        vector<char> keep(k.size());
+        omp_set_num_threads(cores);
+
+#pragma omp parallel for
+        for(size_t i = 0x0; i < k.size(); ++i)
+        {
+            keep[i] = explains(c, e, v, k[i], round9(k[i]), j);
+        }
+
+        if(count_if(keep.begin(), keep.end(), [](const char x) { return x; }) == 0x0)
+        {
+            bad++;
+            return false;
+        }
+        size_t m = 0x0;
+        for(size_t i = 0x0; i < k.size(); ++i)
+        {
+            if(keep[i])
+            {
+                k[m++] = k[i];
+            }
+        }
+        k.resize(m);
+        count++;
+        return true;
+    }
+
+    /* Narrow the product form and run the improved filter as soon as it is cheap */
+    vector<VKeyTuple> x = pending.empty() ? u : intersect(cmb, u);
+    if(product(x) == 0x0)
+    {
+        bad++;
+        return false;
+    }
+    pending.push_back(make_pair(c, e));
+    cand.push_back(v);
+    cmb = x;
+    count++;
+    if(size() <= limit)
+    {
+        materialize();
+    }
+    return true;
+}
+
+size_t Session::size() const
+{
+    if(filtered)
+    {
+        return k.size();
+    }
+    return product(cmb);
+}
+
+bool Session::exact() const
+{
+    return filtered;
+}
+
+size_t Session::pairs() const
+{
+    return count;
+}
+
+size_t Session::rejected() const
+{
+    return bad;
+}
+
+vector<State> Session::keys()
+{
+    materialize();
+    vector<vector<State>> r(0x1, k);
+    return postproc(r);
+}
+
+void Session::materialize()
+{
+    if(filtered || pending.empty())
+    {
+        return;
+    }
+    if(pending.size() == 0x1)
+    {
+        /* A single pair: the plain improved filter per location */
+        k.clear();
+        for(size_t l = 0x0; l < cand[0x0].size(); ++l)
+        {
+            vector<State> v = search(pending[0x0].first, pending[0x0].second, cand[0x0][l], j + l, cores);
+            k.insert(k.end(), v.begin(), v.end());
+        }
+    }
+    else
+    {
+        k = joint_filter(pending, cand, cmb, j, cores);
+    }
+    filtered = true;
+
+    /* A key found at several locations counts once */
+    vector<Located> v(k.size());
+    for(size_t i = 0x0; i < k.size(); ++i)
+    {
+        v[i].k = k[i];
+        v[i].mask = 0x0;
+    }
+    sort_keys(v, cores);
+    k.resize(v.size());
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        k[i] = v[i].k;
+    }
+
+    /* The product form is not needed anymore */
+    pending.clear();
+    cand.clear();
+    cmb.clear();
+}
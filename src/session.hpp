@@ -0,0 +1,45 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "dfa.hpp"
+
+/* Incremental key narrowing for one correct ciphertext as faulty ciphertexts arrive one at a time */
+class Session
+{
+public:
+    Session(const State &c, const size_t j, const size_t n, const size_t cores, const size_t limit = 0x1000000);
+
+    /* Adds a faulty ciphertext, false if it is rejected as a bad capture: without any candidates, or without any in common
+     * with the pairs so far. A rejected pair leaves the remaining candidates as they are. */
+    bool add(const State &d);
+
+    /* Number of remaining candidates, exact once the improved filter has run (otherwise an upper bound) */
+    size_t size() const;
+    bool exact() const;
+    size_t pairs() const;
+    size_t rejected() const;
+
+    /* Remaining master keys, runs the improved filter if not done yet */
+    vector<State> keys();
+
+private:
+    void materialize();
+
+    State c;
+    size_t j, n, cores, limit, count, bad;
+
+    /* Before the improved filter: pending faulty ciphertexts with their column candidates and the intersected product */
+    vector<pair<State, State>> pending;
+    vector<vector<vector<VKeyTuple>>> cand;
+    vector<VKeyTuple> cmb;
+
+    /* After the improved filter: surviving 10-th round keys */
+    bool filtered;
+    vector<State> k;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#!/bin/sh
+# Coordinator with two workers on localhost: the sharded analysis has to give the same keys as the local one, also when a
+# worker hangs (SIGSTOP) while it holds a shard and when it dies.
+set -e
+DFA="$(cd "$(dirname "$0")/.." && pwd)/dfa"
+PAIR="$(cd "$(dirname "$0")" && pwd)/single_bf.csv"
+PORT=${PORT:-7711}
+TMP=$(mktemp -d)
+cd "$TMP"
+mkdir res
+trap 'kill -CONT $W1 $W2 2>/dev/null || true; kill $W1 $W2 2>/dev/null || true; rm -rf "$TMP"' EXIT
+
+$DFA 1 0 nobf "$PAIR" > local.log
+cp res/0.csv local.csv
+
+$DFA --worker=$PORT 1 > w1.log &
+W1=$!
+$DFA --worker=$((PORT + 1)) 1 > w2.log &
+W2=$!
+sleep 1
+
+$DFA --workers=localhost:$PORT,localhost:$((PORT + 1)) 1 0 nobf "$PAIR" > sharded.log 2>&1
+cmp local.csv res/0.csv
+echo "net: sharded ok"
+
+# Stop the second worker as soon as it holds a shard, its shard has to go to the first one
+$DFA --workers=localhost:$PORT,localhost:$((PORT + 1)) --worker-timeout=2 1 0 nobf "$PAIR" > hung.log 2>&1 &
+C=$!
+while ! grep -q Shard w2.log; do sleep 0.1; done
+kill -STOP $W2
+wait $C
+grep -q "timed out" hung.log
+grep -q "Reassigning shard" hung.log
+cmp local.csv res/0.csv
+echo "net: hung worker ok"
+
+# Kill the first worker, the second one is still stopped: everything left is computed locally
+kill $W1
+kill -CONT $W2
+kill $W2
+wait $W1 $W2 2>/dev/null || true
+$DFA --workers=localhost:$PORT 1 0 nobf "$PAIR" > lost.log 2>&1
+grep -q "unreachable" lost.log
+cmp local.csv res/0.csv
+echo "net: lost workers ok"
+
+# A worker claiming more survivors than its shard has candidates is dropped before anything is allocated
+python3 - $PORT > /dev/null <<'PY' &
+import socket, struct, sys
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(("localhost", int(sys.argv[1])))
+s.listen(1)
+c, _ = s.accept()
+req = c.recv(0x31, socket.MSG_WAITALL)
+c.sendall(b"DFA1" + req[4:8] + struct.pack("<I", 0xffffffff))
+c.recv(1)
+PY
+sleep 1
+$DFA --workers=localhost:$PORT 1 0 nobf "$PAIR" > fake.log 2>&1
+grep -q "lost" fake.log
+cmp local.csv res/0.csv
+echo "net: bad survivor count ok"
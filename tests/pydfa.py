@@ -0,0 +1,46 @@
+# Python bindings: input checks, quiet analysis of tests/single_bf.csv and the layout of the returned keys.
+# Run by 'make test' in src/, with the extension module on the path.
+import array
+import os
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"))
+import pydfa
+
+KEY = bytes.fromhex("d26a97b015bec6c526002953bc26b5b7")
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "single_bf.csv")) as f:
+    c, d = [bytes.fromhex(x) for x in f.read().split()[:2]]
+
+# Only unsigned bytes, as (N, 16) or flat N * 16
+for bad in [array.array("i", [0] * 4), array.array("H", [0] * 8), b"\0" * 15, memoryview(b"\0" * 32).cast("B", (2, 16)).cast("B").cast("B", (4, 8))]:
+    try:
+        pydfa.analyse(bad, bad)
+    except TypeError:
+        continue
+    sys.exit("accepted %r" % (bad,))
+print("pydfa: input checks ok")
+
+# Nothing on stdout unless verbose
+out = tempfile.TemporaryFile()
+sys.stdout.flush()
+saved = os.dup(1)
+os.dup2(out.fileno(), 1)
+try:
+    r = pydfa.analyse(memoryview(c).cast("B", (1, 16)), d, l=0, cores=1)
+finally:
+    os.dup2(saved, 1)
+out.seek(0)
+assert out.read() == b"", "output while not verbose"
+print("pydfa: quiet ok")
+
+# Sorted keys viewed in place, one mask bit for location 0
+assert len(r) == 1
+k = r[0]
+m = memoryview(k)
+assert m.shape == (len(k), 16) and m.format == "B" and m.readonly
+assert m.strides == (18, 1), "keys not viewed in place"
+keys = [bytes(x) for x in m.tolist()]
+assert keys == sorted(set(keys)) and KEY in keys
+assert k.masks() == [1] * len(k)
+print("pydfa: keys ok (%d)" % len(k))
@@ -0,0 +1,372 @@
+/**
+ *  Licensed by "The MIT License". See file LICENSE.
+ */
+
+/* Behaviour tests on generated pairs, built and run by 'make test' in src/ */
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "dfa.hpp"
+#include "session.hpp"
+
+static size_t failures = 0x0;
+
+#define CHECK(x) do { if(!(x)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); failures++; } } while(0x0)
+
+static const size_t cores = 0x1;
+
+static State random_state()
+{
+    State x;
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        x[i] = rand();
+    }
+    return x;
+}
+
+/* Correct and faulty ciphertext of 'p' under 'key', with a random fault on byte 'l' at the start of round 'r' */
+static pair<State, State> faulty_pair(const State &key, const State &p, const size_t r, const size_t l)
+{
+    return make_pair(encrypt_fault(key, p, 0x0, 0x0, 0x0), encrypt_fault(key, p, r, l, 0x1 + rand() % 0xff));
+}
+
+static bool contains(const vector<State> &v, const State &x)
+{
+    return find(v.begin(), v.end(), x) != v.end();
+}
+
+/* Two pairs under the same key, faults at unknown locations: the key is among very few survivors */
+static void test_joint()
+{
+    const State key = random_state();
+    vector<pair<State, State>> pairs;
+    for(size_t i = 0x0; i < 0x2; ++i)
+    {
+        pairs.push_back(faulty_pair(key, random_state(), 0x8, rand() % 0x10));
+    }
+    vector<State> k = analyse_joint(pairs, 0x0, 0x10, cores);
+    CHECK(contains(k, key));
+    CHECK(k.size() <= 0x10);
+
+    /* A pair under another key leaves no common candidates */
+    pairs.push_back(faulty_pair(random_state(), random_state(), 0x8, rand() % 0x10));
+    CHECK(analyse_joint(pairs, 0x0, 0x10, cores).empty());
+}
+
+/* Round-9 faults, two per column of the MixColumns input: the key is found. A fault on byte 'l' of the round-9 MixColumns
+ * input is a fault on the byte that ShiftRows moves to 'l', injected at the start of round 9 */
+static void test_round9()
+{
+    const State key = random_state();
+    const State p = random_state();
+    vector<pair<State, State>> pairs;
+    for(size_t i = 0x0; i < 0x8; ++i)
+    {
+        const size_t l = 0x4 * (i / 0x2) + rand() % 0x4;
+        pairs.push_back(faulty_pair(key, p, 0x9, (l + 0x4 * (l % 0x4)) % 0x10));
+    }
+    vector<State> k = analyse_round9(pairs, 0x0, 0x10, cores);
+    CHECK(contains(k, key));
+    CHECK(k.size() <= 0x10);
+}
+
+/* Bad captures are rejected without touching the candidates, the key is found from two good pairs */
+static void test_session()
+{
+    const State key = random_state();
+    const State p = random_state();
+    pair<State, State> a = faulty_pair(key, p, 0x8, 0x5);
+    pair<State, State> b = faulty_pair(key, p, 0x8, 0x5);
+
+    Session s(a.first, 0x5, 0x6, cores);
+    State none = a.first;
+    none[0x0] ^= 0x1;
+    CHECK(!s.add(a.first));
+    CHECK(!s.add(none));
+    CHECK(s.pairs() == 0x0 && s.rejected() == 0x2);
+
+    CHECK(s.add(a.second));
+    const size_t m = s.size();
+    CHECK(m > 0x0);
+    CHECK(!s.add(none));
+    CHECK(s.size() == m);
+    CHECK(s.add(b.second));
+    CHECK(s.exact());
+    CHECK(s.add(faulty_pair(key, p, 0x8, 0x5).second));
+    CHECK(!s.add(none));
+    vector<State> k = s.keys();
+    CHECK(contains(k, key));
+    CHECK(s.pairs() == 0x3 && s.rejected() == 0x4);
+
+    /* A single pair filtered right away: no key twice */
+    Session t(a.first, 0x5, 0x6, cores, SIZE_MAX);
+    CHECK(t.add(a.second) && t.exact());
+    k = t.keys();
+    CHECK(contains(k, key));
+    sort(k.begin(), k.end());
+    CHECK(adjacent_find(k.begin(), k.end()) == k.end());
+}
+
+/* Entry files of a cache directory */
+static vector<string> entries(const string dir)
+{
+    vector<string> r;
+    DIR* d = opendir(dir.c_str());
+    for(struct dirent* e = readdir(d); e != NULL; e = readdir(d))
+    {
+        if(strstr(e->d_name, ".dfac") != NULL)
+        {
+            r.push_back(dir + "/" + e->d_name);
+        }
+    }
+    closedir(d);
+    return r;
+}
+
+/* Round trip, truncated entries are a miss and get removed, least recently used entries go first */
+static void test_cache()
+{
+    char dir[] = "/tmp/dfa_cacheXXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    const size_t entry = 0x38 + 0x4 * 0x10;
+    cache_open(dir, 0x3 * entry - 0x1);
+
+    const State c = random_state();
+    const State d = random_state();
+    vector<State> k(0x4), r;
+    generate(k.begin(), k.end(), random_state);
+    CHECK(!cache_get(c, d, 0x5, "round8", r));
+    cache_put(c, d, 0x5, "round8", k);
+    CHECK(entries(dir).size() == 0x1);
+    CHECK(cache_get(c, d, 0x5, "round8", r) && r == k);
+    CHECK(!cache_get(c, d, 0x6, "round8", r) && !cache_get(c, d, 0x5, "round9", r));
+
+    CHECK(truncate(entries(dir)[0x0].c_str(), entry - 0x8) == 0x0);
+    r.clear();
+    CHECK(!cache_get(c, d, 0x5, "round8", r) && r.empty());
+    CHECK(entries(dir).empty());
+
+    cache_put(c, d, 0x0, "round8", k);
+    cache_put(c, d, 0x1, "round8", k);
+    CHECK(cache_get(c, d, 0x0, "round8", r));
+    cache_put(c, d, 0x2, "round8", k);
+    CHECK(entries(dir).size() == 0x2);
+    CHECK(cache_get(c, d, 0x0, "round8", r) && cache_get(c, d, 0x2, "round8", r) && !cache_get(c, d, 0x1, "round8", r));
+
+    vector<string> v = entries(dir);
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        unlink(v[i].c_str());
+    }
+    rmdir(dir);
+    cache_open("", CACHE_LIMIT);
+}
+
+/* Triage counts of every location class against the column candidates of the standard filter, on faulty and on random
+ * pairs (some of which have no candidates in a column); a pair with an unchanged byte is invalid */
+static void test_triage()
+{
+    const State key = random_state();
+    for(size_t i = 0x0; i < 0x8; ++i)
+    {
+        pair<State, State> x = (i < 0x4) ? faulty_pair(key, random_state(), 0x8, rand() % 0x10)
+                                         : make_pair(random_state(), random_state());
+        const Triage t = triage(x.first, x.second);
+        for(size_t l = 0x0; l < 0x10; ++l)
+        {
+            vector<VKeyTuple> cmb = columns(x.first, x.second, l);
+            for(size_t m = 0x0; m < 0x4; ++m)
+            {
+                CHECK(t.n[map_fault[l]][m] == cmb[m].size());
+            }
+        }
+        bool differ = true;
+        for(size_t b = 0x0; b < 0x10; ++b)
+        {
+            differ &= x.first[b] != x.second[b];
+        }
+        CHECK(t.valid == differ);
+    }
+
+    pair<State, State> x = faulty_pair(key, random_state(), 0x8, 0x3);
+    CHECK(triage(x.first, x.second).valid);
+    x.second[0x6] = x.first[0x6];
+    CHECK(!triage(x.first, x.second).valid);
+}
+
+/* Every vector engine the CPU supports gives the reference survivors, master keys and key verification */
+static void test_engines()
+{
+    const State key = random_state();
+    pair<State, State> x = faulty_pair(key, random_state(), 0x8, 0x9);
+    const char* names[] = {"avx512", "avx2", "sse"};
+    for(size_t i = 0x0; i < 0x3; ++i)
+    {
+        const Engine* e = find_engine(names[i]);
+        if(e != NULL)
+        {
+            CHECK(verify_engine(*e, x.first, x.second, 0x9, 0x1, cores) == 0x0);
+        }
+    }
+}
+
+/* 'n' keys drawn from 'm' random ones, so that most appear several times, with random location masks */
+static vector<Located> random_keys(const size_t n, const size_t m)
+{
+    vector<State> pool(m);
+    generate(pool.begin(), pool.end(), random_state);
+    vector<Located> v(n);
+    for(size_t i = 0x0; i < n; ++i)
+    {
+        v[i].k = pool[rand() % m];
+        v[i].mask = 0x1 << (rand() % 0x10);
+    }
+    return v;
+}
+
+/* Sorted unique keys with the OR of their masks, by std::map */
+static vector<pair<State, uint16_t>> merged(const vector<Located> &v)
+{
+    map<State, uint16_t> m;
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        m[v[i].k] |= v[i].mask;
+    }
+    return vector<pair<State, uint16_t>>(m.begin(), m.end());
+}
+
+static vector<pair<State, uint16_t>> pairs_of(const vector<Located> &v)
+{
+    vector<pair<State, uint16_t>> r;
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        r.push_back(make_pair(v[i].k, v[i].mask));
+    }
+    return r;
+}
+
+/* Radix sort and linear merge against std::sort, std::unique and std::set_intersection, also on several threads and
+ * with empty lists or a single distinct key */
+static void test_sort()
+{
+    const size_t n[] = {0x0, 0x1, 0x7, 0x1000, 0x9000};
+    for(size_t i = 0x0; i < sizeof(n) / sizeof(n[0x0]); ++i)
+    {
+        for(size_t t = 0x1; t <= 0x4; t += 0x3)
+        {
+            vector<Located> a = random_keys(n[i], max(n[i] / 0x4, (size_t) 0x1));
+            vector<Located> b = random_keys(n[i] / 0x2, max(n[i] / 0x4, (size_t) 0x1));
+            b.insert(b.end(), a.begin(), a.begin() + n[i] / 0x3);
+            vector<pair<State, uint16_t>> x = merged(a);
+            vector<pair<State, uint16_t>> y = merged(b);
+
+            vector<State> u;
+            for(size_t j = 0x0; j < a.size(); ++j)
+            {
+                u.push_back(a[j].k);
+            }
+            sort(u.begin(), u.end());
+            u.erase(unique(u.begin(), u.end()), u.end());
+
+            sort_keys(a, t);
+            sort_keys(b, t);
+            CHECK(pairs_of(a) == x && pairs_of(b) == y);
+            CHECK(a.size() == u.size());
+
+            vector<State> ka, kb, w;
+            for(size_t j = 0x0; j < x.size(); ++j)
+            {
+                ka.push_back(x[j].first);
+            }
+            for(size_t j = 0x0; j < y.size(); ++j)
+            {
+                kb.push_back(y[j].first);
+            }
+            set_intersection(ka.begin(), ka.end(), kb.begin(), kb.end(), back_inserter(w));
+            vector<Located> r = intersect_keys(a, b);
+            CHECK(r.size() == w.size());
+            for(size_t j = 0x0; j < r.size() && j < w.size(); ++j)
+            {
+                const uint16_t mask = lower_bound(x.begin(), x.end(), make_pair(w[j], (uint16_t) 0x0))->second |
+                                      lower_bound(y.begin(), y.end(), make_pair(w[j], (uint16_t) 0x0))->second;
+                CHECK(r[j].k == w[j] && r[j].mask == mask);
+            }
+        }
+    }
+}
+
+/* Contents of 'file' */
+static string slurp(const string file)
+{
+    ifstream in(file.c_str(), ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+/* 'x' in hex the way the key files were originally written, with fprintf("%02x") */
+static string printed(const State &x)
+{
+    char b[0x21];
+    for(size_t i = 0x0; i < 0x10; ++i)
+    {
+        snprintf(b + 0x2 * i, 0x3, "%02x", x[i]);
+    }
+    return string(b, 0x20);
+}
+
+/* Key and mask files byte for byte as with fprintf: no keys, then keys over several blocks appended, masks */
+static void test_write()
+{
+    char name[] = "/tmp/dfa_keysXXXXXX";
+    const int fd = mkstemp(name);
+    CHECK(fd >= 0x0);
+    close(fd);
+
+    const State p = random_state();
+    const State c = random_state();
+    vector<State> k(0x20005);
+    generate(k.begin(), k.end(), random_state);
+    writefile(p, c, vector<State>(), name);
+    string expected = printed(p) + "\n" + printed(c) + "\n";
+    CHECK(slurp(name) == expected);
+    writefile(c, p, k, name);
+    expected += printed(c) + "\n" + printed(p) + "\n";
+    for(size_t i = 0x0; i < k.size(); ++i)
+    {
+        expected += printed(k[i]) + "\n";
+    }
+    CHECK(slurp(name) == expected);
+
+    vector<Located> v(0x3);
+    expected.clear();
+    for(size_t i = 0x0; i < v.size(); ++i)
+    {
+        char m[0x6];
+        v[i].k = k[i];
+        v[i].mask = (i == 0x0) ? 0xffff : rand();
+        snprintf(m, sizeof(m), "%04x", v[i].mask);
+        expected += printed(v[i].k) + " " + m + "\n";
+    }
+    writemasks(v, name);
+    CHECK(slurp(name) == expected);
+    writemasks(vector<Located>(), name);
+    CHECK(slurp(name).empty());
+    unlink(name);
+}
+
+int main()
+{
+    srand(0x1);
+    test_cache();
+    test_write();
+    test_sort();
+    test_triage();
+    test_engines();
+    test_joint();
+    test_round9();
+    test_session();
+    printf("\n%s\n", failures ? "TESTS FAILED !!!" : "All tests passed.");
+    return failures ? 0x1 : 0x0;
+}